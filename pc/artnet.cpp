@@ -27,9 +27,13 @@ THE SOFTWARE.*/
 #include <cstring>
 #include <cassert>
 #include <cerrno>
+#include <cstdio>
 #include "datahelper.h"
 #include "logger.h"
-#include "messages.h"
+#include "settings.h"
+#include "outputconfig.h"
+#include "timehelper.h"
+#include "metrics.h"
 #include "artnet.h"
 
 enum ArtNetOpcodes {
@@ -39,6 +43,7 @@ enum ArtNetOpcodes {
 	OpCommand = 0x2400,
 	OpDmx = 0x5000,
 	OpNzs = 0x5100,
+	OpSync = 0x5200,
 	OpAddress = 0x6000,
 	OpInput = 0x7000,
 	OpTodRequest = 0x8000,
@@ -69,10 +74,71 @@ enum ArtNetOpcodes {
 	OpDirectoryReply = 0x9b00
 };
 
-ArtNet::ArtNet(std::string ip, IPC *ipc)
+// Layout of the ArtPollReply packet
+struct ArtPollReply {
+	char id[8];
+	uint8_t opcode[2];
+	uint8_t ip[4];
+	uint8_t port[2];
+	uint8_t versInfo[2];
+	uint8_t netSwitch;
+	uint8_t subSwitch;
+	uint8_t oem[2];
+	uint8_t ubeaVersion;
+	uint8_t status1;
+	uint8_t estaMan[2];
+	char shortName[18];
+	char longName[64];
+	char nodeReport[64];
+	uint8_t numPorts[2];
+	uint8_t portTypes[4];
+	uint8_t goodInput[4];
+	uint8_t goodOutput[4];
+	uint8_t swIn[4];
+	uint8_t swOut[4];
+	uint8_t swVideo;
+	uint8_t swMacro;
+	uint8_t swRemote;
+	uint8_t spare[3];
+	uint8_t style;
+	uint8_t mac[6];
+	uint8_t bindIp[4];
+	uint8_t bindIndex;
+	uint8_t status2;
+	uint8_t filler[26];
+} __attribute__((packed));
+
+static_assert(sizeof(ArtPollReply) == ARTNETPOLLREPLYSIZE, "Invalid ArtPollReply size");
+
+ArtNet::ArtNet(std::string ip, MergeEngine *merge) :
+	mSequences(MAXOUTPUTS, ARTNETSEQUENCETIMEOUT * 1000000ULL)
 {
-	assert(ipc != NULL);
-	mIpc = ipc;
+	assert(merge != NULL);
+	mMerge = merge;
+	mBuffer = NULL;
+	mPollReplyCount = 0;
+	mSyncMode = false;
+	mSyncTime = 0;
+	mSyncTimeout = Settings::GetArtNetSyncTimeout() > 0 ?
+		Settings::GetArtNetSyncTimeout() * 1000000ULL : 0;
+	std::vector<OutputConfig> outputs = GetOutputConfigs();
+	mPorts.resize(outputs.size());
+	for(size_t i = 0; i < outputs.size(); i++)
+	{
+		mRoutes.Add(outputs[i].portAddress, i);
+		mPorts[i].portAddress = outputs[i].portAddress;
+		mPorts[i].dmxTime = 0;
+		mPorts[i].stagedCount = 0;
+	}
+	
+	// Get the address to bind to
+	struct in_addr addr;
+	if(inet_aton(ip.c_str(), &addr) == 0)
+	{
+		Warn("ART-NET: Invalid ip address %s, binding to all interfaces", ip.c_str());
+		addr.s_addr = htonl(INADDR_ANY);
+	}
+	mBindAddress = addr.s_addr;
 	
 	// Create the socket
 	mSocket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
@@ -87,9 +153,15 @@ ArtNet::ArtNet(std::string ip, IPC *ipc)
 	setsockopt(mSocket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
 	int reuse = 1;
 	setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	// Room for bursts of many universes
+	int receiveBuffer = ARTNETRECEIVEBUFFER;
+	setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+	// Stamp the datagrams when they are received, to trace the latency of the frames
+	int timestamp = 1;
+	setsockopt(mSocket, SOL_SOCKET, SO_TIMESTAMPNS, &timestamp, sizeof(timestamp));
 	
 	
-	// Bind the socket
+	// Bind the socket, Art-Net data is broadcasted so bind to all interfaces
 	struct sockaddr_in address;
 	memset(&address, 0, sizeof(address));
 	address.sin_family = AF_INET;
@@ -98,24 +170,36 @@ ArtNet::ArtNet(std::string ip, IPC *ipc)
 	if(bind(mSocket, (sockaddr *)&address, sizeof(address)) < 0)
 	{
 		Error("ART-NET: Could not bind the socket: %s", strerror(errno));
+		close(mSocket);
+		mSocket = -1;
 		return;
 	}
 	
-	// Creating the buffer
-	mBuffer = NULL;
-	mBuffer = new char[ARTNETBUFFERSIZE];
+	// Creating the receive slots
+	mBuffer = new char[ARTNETBATCHSIZE * ARTNETBUFFERSIZE];
+	memset(mMessages, 0, sizeof(mMessages));
+	for(int i = 0; i < ARTNETBATCHSIZE; i++)
+	{
+		mIovecs[i].iov_base = mBuffer + i * ARTNETBUFFERSIZE;
+		mIovecs[i].iov_len = ARTNETBUFFERSIZE;
+		mMessages[i].msg_hdr.msg_iov = &mIovecs[i];
+		mMessages[i].msg_hdr.msg_iovlen = 1;
+		mMessages[i].msg_hdr.msg_name = &mAddresses[i];
+	}
 	
-	// Set the destination ip
-	struct in_addr addr;
-	inet_aton(ip.c_str(), &addr);
-	mDest = addr.s_addr;
+	for(size_t i = 0; i < mPorts.size(); i++)
+	{
+		CreatePollReply(mPorts[i], i);
+		Inform("ART-NET: Listening on port address %d:%d:%d", mPorts[i].portAddress >> 8,
+			(mPorts[i].portAddress >> 4) & 0x0F, mPorts[i].portAddress & 0x0F);
+	}
 }
 
 ArtNet::~ArtNet()
 {
 	if(mBuffer)
 		delete[] mBuffer;
-	if(mSocket > 0)
+	if(mSocket >= 0)
 	{
 		close(mSocket);
 	}
@@ -123,53 +207,178 @@ ArtNet::~ArtNet()
 
 bool ArtNet::IsValid() const
 {
-	return mSocket >0;
+	return mSocket >= 0;
+}
+
+int ArtNet::GetSocket() const
+{
+	return mSocket;
 }
 
 void ArtNet::Tick()
 {
 	assert(IsValid());
-	struct sockaddr_in other;
-	socklen_t otherLen;
 	
-	int flags = 0;
-	ssize_t len;
+	int count;
 	do {
-		len = recvfrom(mSocket, mBuffer, ARTNETBUFFERSIZE-1, 0, (sockaddr *)&other, &otherLen);
-		if(len < 0 && errno != EAGAIN)
+		for(int i = 0; i < ARTNETBATCHSIZE; i++)
+		{
+			mMessages[i].msg_hdr.msg_namelen = sizeof(mAddresses[i]);
+			mMessages[i].msg_hdr.msg_control = mControls[i];
+			mMessages[i].msg_hdr.msg_controllen = sizeof(mControls[i]);
+		}
+		count = recvmmsg(mSocket, mMessages, ARTNETBATCHSIZE, MSG_DONTWAIT, NULL);
+		if(count < 0)
 		{
-			Error("ART-NET: Error while reading socket: %s", strerror(errno));
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				Error("ART-NET: Error while reading socket: %s", strerror(errno));
+			}
 			break;
 		}
-		if(len > 0 && IsArtNetMessage(mBuffer))
+		HandleBatch(count);
+		// A full batch means that there can be more datagrams waiting
+	} while(count == ARTNETBATCHSIZE);
+}
+
+uint64_t ArtNet::GetNextTimeout() const
+{
+	// Only synchronous mode times out
+	return mSyncMode ? mSyncTime + mSyncTimeout : 0;
+}
+
+void ArtNet::HandleTimeouts()
+{
+	CheckSyncTimeout();
+}
+
+void ArtNet::ReportStatistics()
+{
+	mSequences.Report("ART-NET sequence numbers");
+}
+
+void ArtNet::HandleBatch(int count)
+{
+	CheckSyncTimeout();
+	for(int i = 0; i < count; i++)
+	{
+		const char *buffer = (const char *)mIovecs[i].iov_base;
+		int len = mMessages[i].msg_len;
+		if((mMessages[i].msg_hdr.msg_flags & MSG_TRUNC) || !IsArtNetMessage(buffer, len))
+			continue;
+		
+		unsigned short opcode;
+		unsigned short protVer;
+		GetArtNetMessageInfo(buffer, &opcode, &protVer);
+		//Debug("ART-NET: Received Art-Net Message len: %d, opcode: %04x, protVer: %04x", len, opcode, protVer);
+		switch((ArtNetOpcodes)opcode)
 		{
-			unsigned short opcode;
-			unsigned short protVer;
-			GetArtNetMessageInfo(mBuffer, &opcode, &protVer);
-			//Debug("ART-NET: Received Art-Net Message len: %d, opcode: %04x, protVerHi: %02x, protVerLo: %02x", len, opcode, protVerHi, protVerLo);
-			switch((ArtNetOpcodes)opcode)
+			case OpPoll:
+				Metrics::Add(METRIC_ARTNET_OPPOLL);
+				HandleOpPoll(buffer, len, mAddresses[i]);
+				break;
+			case OpPollReply:
+				Metrics::Add(METRIC_ARTNET_OPPOLLREPLY);
+				HandleOpPollReply(buffer, len);
+				break;
+			case OpDmx:
 			{
-				case OpPoll:
-					HandleOpPoll(mBuffer);
-					break;
-				case OpPollReply:
-					HandleOpPollReply(mBuffer);
+				Metrics::Add(METRIC_ARTNET_OPDMX);
+				ArtDmxFrame frame;
+				if(!ParseOpDmx(buffer, len, mAddresses[i], &frame))
 					break;
-				case OpDmx:
-					HandleOpDmx(mBuffer);
+				frame.stamp = GetReceiveTime(mMessages[i].msg_hdr);
+				if(mSyncMode)
+				{
+					StageFrame(frame);
 					break;
-				
+				}
+				HandleOpDmx(frame);
+				break;
 			}
-			
+			case OpSync:
+				Metrics::Add(METRIC_ARTNET_OPSYNC);
+				if(mSyncTimeout == 0 || len < ARTNETSYNCSIZE)
+					break;
+				// Frames that were received before the first ArtSync are not staged
+				mMerge->Flush();
+				HandleOpSync();
+				break;
+			default:
+				Metrics::Add(METRIC_ARTNET_OTHER);
+				break;
+		}
+	}
+	
+	// Every output is sent once with the merge of the newest frames of its sources
+	mMerge->Flush();
+}
+
+void ArtNet::StageFrame(const ArtDmxFrame &frame)
+{
+	Port &port = mPorts[frame.output];
+	int index = 0;
+	while(index < port.stagedCount && port.staged[index].source != frame.source)
+		index++;
+	if(index == port.stagedCount)
+	{
+		// The merge engine would ignore the frame of another source too
+		if(port.stagedCount == MERGE_MAXSOURCES)
+		{
+			Metrics::Add(METRIC_FRAMES_DROPPED);
+			return;
+		}
+		port.stagedCount++;
+	}
+	StagedFrame &staged = port.staged[index];
+	memcpy(staged.data, frame.data, frame.length);
+	staged.length = frame.length;
+	staged.source = frame.source;
+	staged.time = frame.time;
+	staged.stamp = frame.stamp;
+}
+
+void ArtNet::CommitStaged()
+{
+	for(size_t i = 0; i < mPorts.size(); i++)
+	{
+		Port &port = mPorts[i];
+		for(int j = 0; j < port.stagedCount; j++)
+		{
+			StagedFrame &staged = port.staged[j];
+			mMerge->SetFrame(i, staged.source, MERGE_DEFAULTPRIORITY, staged.data,
+				staged.length, staged.time, staged.stamp);
 		}
-	} while(len > 0);
+		port.stagedCount = 0;
+	}
+	mMerge->Flush();
+}
+
+void ArtNet::HandleOpSync()
+{
+	if(!mSyncMode)
+	{
+		Inform("ART-NET: ArtSync received, output is synchronized");
+		mSyncMode = true;
+	}
+	mSyncTime = GetMonotonicTime();
+	CommitStaged();
+}
+
+void ArtNet::CheckSyncTimeout()
+{
+	if(!mSyncMode || GetMonotonicTime() - mSyncTime < mSyncTimeout)
+		return;
+	Inform("ART-NET: No ArtSync received, output is no longer synchronized");
+	mSyncMode = false;
+	CommitStaged();
 }
 
-bool ArtNet::IsArtNetMessage(const char *buffer) const
+bool ArtNet::IsArtNetMessage(const char *buffer, int len) const
 {
 	static const char ArtNetId[] = "Art-Net";
 	assert(buffer != NULL);
-	return memcmp(buffer, ArtNetId, sizeof(ArtNetId)) == 0;
+	return len >= ARTNETHEADERSIZE && memcmp(buffer, ArtNetId, sizeof(ArtNetId)) == 0;
 }
 
 
@@ -187,82 +396,142 @@ void ArtNet::GetArtNetMessageInfo(const char * buffer, unsigned short *opcode,
 	}
 }
 
-void ArtNet::HandleOpPoll(const char *buffer)
+void ArtNet::CreatePollReply(Port &port, int index)
 {
-	// Send Poll reply
-	static unsigned char reply[] = {
-		'A', 'r', 't', '-', 'N', 'e', 't', 0, // ID
-		(OpPollReply & 0xFF), (OpPollReply>>8)&0xFF, // Opcode
-		192,168,2,100, // IP address
-		(ARTNETPORT & 0xFF), (ARTNETPORT>>8)&0xFF, // Port
-		0,0, // Version info
-		(unsigned char)mNet, (unsigned char)mUniverse, // Universe
-		0xFF, 0x7F, // OEM code prototypeing use
-		0, // Ubea version
-		0, // Status 1
-		'R', 'J', // ESTA code
-		'R', 'P', 'I', '-', 'S', 'P', 'I', ' ', 'D', 'M', 'X', 0,0,0,0,0,0,0, // Short name
-		'R', 'P', 'I', '-', 'S', 'P', 'I', ' ', 'D', 'M', 'X', ' ', // Long name
-		'h', 't', 't', 'p', ':', '/', '/', 'w', 'w', 'w', '.', 'r',
-		'o', 'b', 'o', 'j', 'a', 'n', '.', 'n', 'l', 0, 0, 0,
-		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-		0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, // Node Report
-		0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
-		0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
-		0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
-		0, 1, // Input/output ports
-		0x80, 0, 0, 0, // Port types
-		0, 0, 0, 0, // Good input
-		0, 0, 0, 0, // Good output
-		0, 0, 0, 0, // swin
-		0, 0, 0, 0, // swout
-		0, // swvideo
-		0, // swmacro
-		0, // swRemote
-		0, 0, 0, 0, // spare
-		0, // style		
-		0,0,0,0,0,0, // Mac address
-		0,0,0,0, // Bind IP
-		0, //Bound index
-		0x02, // Status 2
-		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0 // Filler
-	};
+	ArtPollReply *reply = (ArtPollReply *)port.pollReply;
+	memset(reply, 0, sizeof(*reply));
+	memcpy(reply->id, "Art-Net", 8);
+	DataHelper::SetUint16(reply->opcode, OpPollReply);
+	DataHelper::SetUint16(reply->port, ARTNETPORT);
+	reply->netSwitch = port.portAddress >> 8;
+	reply->subSwitch = (port.portAddress >> 4) & 0x0F;
+	reply->oem[0] = 0xFF; // OEM code prototyping use
+	reply->oem[1] = 0x7F;
+	reply->estaMan[0] = 'R'; // ESTA code
+	reply->estaMan[1] = 'J';
+	strncpy(reply->shortName, Settings::GetArtNetShortName().c_str(), sizeof(reply->shortName) - 1);
+	strncpy(reply->longName, Settings::GetArtNetLongName().c_str(), sizeof(reply->longName) - 1);
+	reply->numPorts[1] = 1; // One output port
+	reply->portTypes[0] = 0x80; // Can output DMX512 from Art-Net
+	reply->swOut[0] = port.portAddress & 0x0F;
+	reply->style = 0; // StNode
+	memcpy(reply->bindIp, &mBindAddress, 4);
+	reply->bindIndex = index + 1; // The first port is the root device
+	reply->status2 = 0x08; // Supports 15 bit port addresses
+}
+
+in_addr_t ArtNet::GetNodeAddress(const struct sockaddr_in &sender)
+{
+	if(mBindAddress != htonl(INADDR_ANY))
+		return mBindAddress;
 	
+	// Let the routing table find the address of the interface that reaches the sender
+	in_addr_t result = htonl(INADDR_ANY);
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(sock < 0)
+		return result;
+	struct sockaddr_in address = sender;
+	address.sin_port = htons(ARTNETPORT);
+	if(connect(sock, (const sockaddr *)&address, sizeof(address)) == 0)
+	{
+		socklen_t addressLen = sizeof(address);
+		if(getsockname(sock, (sockaddr *)&address, &addressLen) == 0)
+		{
+			result = address.sin_addr.s_addr;
+		}
+	}
+	close(sock);
+	return result;
+}
+
+void ArtNet::HandleOpPoll(const char *buffer, int len, const struct sockaddr_in &sender)
+{
 	//Debug("ART-NET: Poll");
 	
+	in_addr_t nodeAddress = GetNodeAddress(sender);
+	uint64_t now = GetMonotonicTime();
+	mPollReplyCount = (mPollReplyCount + 1) % 10000;
+	
+	// Reply directly to the controller that sent the poll
 	struct sockaddr_in address;
 	memset(&address, 0, sizeof(address));
 	address.sin_family = AF_INET;
 	address.sin_port = htons(ARTNETPORT);
-	address.sin_addr.s_addr = mDest;
-	if(sendto(mSocket, reply, sizeof(reply), 0, (struct sockaddr *)&address, sizeof(address)) < 0)
+	address.sin_addr = sender.sin_addr;
+	
+	for(size_t i = 0; i < mPorts.size(); i++)
 	{
-		Error("ART-NET: Could not send PollReply");
+		Port &port = mPorts[i];
+		ArtPollReply *reply = (ArtPollReply *)port.pollReply;
+		memcpy(reply->ip, &nodeAddress, 4);
+		
+		bool active = port.dmxTime != 0 &&
+			now - port.dmxTime < ARTNETDATATIMEOUT * 1000000ULL;
+		reply->goodOutput[0] = active ? 0x80 : 0x00;
+		
+		snprintf(reply->nodeReport, sizeof(reply->nodeReport), "#0001 [%04u] Power On Tests successful",
+			mPollReplyCount);
+		
+		if(sendto(mSocket, port.pollReply, sizeof(port.pollReply), 0, (struct sockaddr *)&address, sizeof(address)) < 0)
+		{
+			Error("ART-NET: Could not send PollReply: %s", strerror(errno));
+		}
 	}
 }
 
-void ArtNet::HandleOpPollReply(const char *buffer)
+void ArtNet::HandleOpPollReply(const char *buffer, int len)
 {
 	//Debug("ART-NET: PollReply");
 }
 
-void ArtNet::HandleOpDmx(const char *buffer)
+bool ArtNet::ParseOpDmx(const char *buffer, int len, const struct sockaddr_in &sender, ArtDmxFrame *frame)
 {
-	unsigned char sequence = DataHelper::GetUint8((const unsigned char *)buffer+12);
-	unsigned char physical = DataHelper::GetUint8((const unsigned char *)buffer+13);
-	unsigned char subUni = DataHelper::GetUint8((const unsigned char *)buffer+14);
-	unsigned char net = DataHelper::GetUint8((const unsigned char *)buffer+15);
-	unsigned char lengthHi= DataHelper::GetUint8((const unsigned char *)buffer+16);
-	unsigned char lengthLo= DataHelper::GetUint8((const unsigned char *)buffer+17);
+	if(len < ARTNETDMXHEADERSIZE)
+		return false;
+	const unsigned char *data = (const unsigned char *)buffer;
+	unsigned char subUni = DataHelper::GetUint8(data+14);
+	unsigned char net = DataHelper::GetUint8(data+15);
+	unsigned short portAddress = ((net & 0x7F) << 8) | subUni;
+	
+	// Only handle the universes of our output ports, most traffic on a
+	// busy network is for other nodes so it is rejected first
+	int output = mRoutes.Lookup(portAddress);
+	if(output < 0)
+		return false;
+	Port &port = mPorts[output];
+	
+	unsigned char sequence = DataHelper::GetUint8(data+12);
+	unsigned char lengthHi= DataHelper::GetUint8(data+16);
+	unsigned char lengthLo= DataHelper::GetUint8(data+17);
 	unsigned short length = (lengthHi<<8)|(lengthLo);
 	
-	IPCMessage *message = SetChannelsMessage(1, length, (const unsigned char *)buffer + 18);
-	mIpc->SendMessage(*message);
-	delete message;
+	if(length > ARTNETMAXCHANNELS)
+		length = ARTNETMAXCHANNELS;
+	if(length > len - ARTNETDMXHEADERSIZE)
+		length = len - ARTNETDMXHEADERSIZE;
+	
+	// Reject packets that were overtaken by a newer packet of the same sender
+	uint64_t now = GetMonotonicTime();
+	uint64_t source = ((uint64_t)sender.sin_addr.s_addr << 16) | sender.sin_port;
+	if(!mSequences.Accept(output, source, sequence, now))
+		return false;
+	port.dmxTime = now;
 	
-	unsigned char ch1= DataHelper::GetUint8((const unsigned char *)buffer+18);
+	frame->portAddress = portAddress;
+	frame->output = output;
+	frame->source = source;
+	frame->time = now;
+	frame->stamp = 0;
+	frame->length = length;
+	frame->data = data + ARTNETDMXHEADERSIZE;
 	
-	//Debug("ART-NET: dmx Ch1: %d", ch1);
-	/*Debug("ART-NET: Dmx packet: seq: %d, phy: %d, sub: %d, net: %d, length: %d",
-		sequence, physical, subUni, net, length);*/
+	/*Debug("ART-NET: Dmx packet: seq: %d, sub: %d, net: %d, length: %d",
+		sequence, subUni, net, length);*/
+	return true;
+}
+
+void ArtNet::HandleOpDmx(const ArtDmxFrame &frame)
+{
+	mMerge->SetFrame(frame.output, frame.source, MERGE_DEFAULTPRIORITY, frame.data,
+		frame.length, frame.time, frame.stamp);
 }
\ No newline at end of file
@@ -23,36 +23,139 @@ THE SOFTWARE.*/
 #define _ARTNET_H_
 
 #include <string>
-#include "ipc.h"
+#include <vector>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "mergeengine.h"
+#include "timehelper.h"
+#include "routingtable.h"
+#include "sequencetracker.h"
+#include "artnetengine.h"
 
 #define ARTNETPORT	6454
-#define ARTNETBUFFERSIZE 10000
+// Size of a receive slot, the largest packet that is handled is an OpDmx of 530 bytes
+#define ARTNETBUFFERSIZE 1024
+// Number of datagrams that are received with one system call
+#define ARTNETBATCHSIZE 32
+// Requested size of the socket receive buffer
+#define ARTNETRECEIVEBUFFER (256*1024)
 #define ARTNETPROTVER 14
+#define ARTNETHEADERSIZE 12
+#define ARTNETDMXHEADERSIZE 18
+#define ARTNETMAXCHANNELS 512
+#define ARTNETPOLLREPLYSIZE 239
+#define ARTNETSYNCSIZE 14
+// Time in ms after which the sequence number of the source is no longer checked
+#define ARTNETSEQUENCETIMEOUT 1000
+// Time in ms that the output is reported as active after the last dmx packet
+#define ARTNETDATATIMEOUT 4000
 
-class ArtNet {
+// Received OpDmx packet
+struct ArtDmxFrame {
+	// 15 bit port address
+	unsigned short portAddress;
+	// Output that the universe is sent to
+	int output;
+	// Sender of the frame, its address and port
+	uint64_t source;
+	// Receive time in ns
+	uint64_t time;
+	// Receive time of the datagram on the realtime clock, for latency tracing
+	uint64_t stamp;
+	unsigned short length;
+	const unsigned char *data;
+};
+
+// Native Art-Net node
+class ArtNet : public ArtNetEngine {
 public:
-	ArtNet(std::string ip, IPC *ipc);
+	ArtNet(std::string ip, MergeEngine *merge);
 	~ArtNet();
 	
 	bool IsValid() const;
+	// Returns the UDP socket, it becomes readable when Tick has work to do
+	int GetSocket() const;
 	
 	void Tick();
+	uint64_t GetNextTimeout() const;
+	void HandleTimeouts();
+	void ReportStatistics();
+	
+	// Returns true when the packet is a valid OpDmx for one of our output ports
+	// that is newer than the last packet of the sender
+	bool ParseOpDmx(const char *buffer, int len, const struct sockaddr_in &sender, ArtDmxFrame *frame);
+	// Pass the frame to the merge engine, it is sent to the dmx process at the end of the batch
+	void HandleOpDmx(const ArtDmxFrame &frame);
 private:
-	void HandleOpPoll(const char *buffer);
-	void HandleOpPollReply(const char *buffer);
-	void HandleOpDmx(const char *buffer);
+	void HandleOpPoll(const char *buffer, int len, const struct sockaddr_in &sender);
+	void HandleOpPollReply(const char *buffer, int len);
+	// Output the staged frames and stay in synchronous mode
+	void HandleOpSync();
+	// Handle the received datagrams in the receive slots
+	void HandleBatch(int count);
+	// Copy the frame to its port, it is output at the next ArtSync
+	// Every source of a port has its own staged frame
+	void StageFrame(const ArtDmxFrame &frame);
+	// Pass the staged frames of all sources and ports to the merge engine and output them
+	void CommitStaged();
+	// Go back to immediate mode when no ArtSync was received for too long
+	void CheckSyncTimeout();
 	
-	bool IsArtNetMessage(const char *buffer) const;
+	bool IsArtNetMessage(const char *buffer, int len) const;
 	void GetArtNetMessageInfo(const char * buffer, unsigned short *opcode,
 		unsigned short *protVer) const;
+	// Frame of a source that is waiting for an ArtSync
+	struct StagedFrame {
+		uint64_t source;
+		unsigned char data[ARTNETMAXCHANNELS];
+		int length;
+		uint64_t time;
+		uint64_t stamp;
+	};
+	// Output port of the node, every port outputs one universe
+	struct Port {
+		// 15 bit port address
+		unsigned short portAddress;
+		uint64_t dmxTime;
+		// Every port is reported in its own poll reply
+		unsigned char pollReply[ARTNETPOLLREPLYSIZE];
+		// Newest frame of every source since the last ArtSync, the merge engine
+		// does not merge more sources
+		StagedFrame staged[MERGE_MAXSOURCES];
+		int stagedCount;
+	};
+	
+	// Fill in the parts of the poll reply of a port that do not change
+	void CreatePollReply(Port &port, int index);
+	// Returns the address of this node as seen by sender in network order
+	in_addr_t GetNodeAddress(const struct sockaddr_in &sender);
 
-	int mChannelCount;
-	int mUniverse;
-	int mNet;
-	IPC *mIpc;
-	unsigned int mDest;
-	char *mBuffer;
+	// The output ports, the index is the output in the dmx process
+	std::vector<Port> mPorts;
+	// Port index of every port address
+	RoutingTable mRoutes;
+	// Sequence numbers of the senders of every port
+	SequenceTracker mSequences;
+	MergeEngine *mMerge;
+	in_addr_t mBindAddress;
 	int mSocket;
+	
+	// Preallocated receive slots for recvmmsg
+	char *mBuffer;
+	struct mmsghdr mMessages[ARTNETBATCHSIZE];
+	struct iovec mIovecs[ARTNETBATCHSIZE];
+	struct sockaddr_in mAddresses[ARTNETBATCHSIZE];
+	// Receive the kernel time stamps of the datagrams
+	char mControls[ARTNETBATCHSIZE][RECEIVETIME_CONTROLSIZE];
+	
+	unsigned int mPollReplyCount;
+	
+	// In synchronous mode frames are staged until an ArtSync is received
+	bool mSyncMode;
+	uint64_t mSyncTime;
+	// Time in ns without ArtSync after which synchronous mode ends, 0 disables ArtSync
+	uint64_t mSyncTimeout;
 };
 
-#endif
\ No newline at end of file
+#endif
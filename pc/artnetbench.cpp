@@ -0,0 +1,227 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+// Benchmark of the Art-Net engines
+// Sends bursts of OpDmx packets over the loopback interface to an engine and
+// measures how many packets per second it handles and how much cpu time
+// every packet costs.
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include "datahelper.h"
+#include "ipc.h"
+#include "messages.h"
+#include "mergeengine.h"
+#include "artnet.h"
+#include "artnetengine.h"
+#include "outputconfig.h"
+#include "timehelper.h"
+
+#define BENCH_BURSTSIZE 32
+
+struct BenchResult {
+	uint64_t sent;
+	uint64_t received;
+	uint64_t wallTime;
+	uint64_t cpuTime;
+};
+
+static uint64_t GetThreadCpuTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return TimespecToNs(ts);
+}
+
+// Read all frames from the pipe, returns the number of complete frames
+// bytes contains the number of bytes of the incomplete frame
+static uint64_t DrainPipe(int fd, int frameSize, uint64_t *bytes)
+{
+	static unsigned char buffer[65536];
+	ssize_t len;
+	while((len = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		*bytes += len;
+	}
+	uint64_t frames = *bytes / frameSize;
+	*bytes %= frameSize;
+	return frames;
+}
+
+static bool RunBenchmark(const std::string &engineName, const char *ip, const char *sourceIp,
+	int packets, int channels, BenchResult *result)
+{
+	int pipes[2];
+	if(pipe(pipes) < 0)
+	{
+		fprintf(stderr, "Could not create pipe: %s\n", strerror(errno));
+		return false;
+	}
+	fcntl(pipes[1], F_SETPIPE_SZ, 1024*1024);
+	IPC ipc(pipes[0], pipes[1]);
+	MergeEngine merge(&ipc, GetOutputConfigs().size(), MERGE_HTP, 1000000000ULL);
+	
+	ArtNetEngine *engine = CreateArtNetEngine(engineName, ip, &merge);
+	if(engine == NULL || !engine->IsValid())
+	{
+		fprintf(stderr, "Could not start the %s engine\n", engineName.c_str());
+		delete engine;
+		close(pipes[0]);
+		close(pipes[1]);
+		return false;
+	}
+	
+	// Create the sender
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	if(sourceIp != NULL)
+	{
+		inet_aton(sourceIp, &address.sin_addr);
+		if(bind(sock, (sockaddr *)&address, sizeof(address)) < 0)
+		{
+			fprintf(stderr, "Could not bind to %s: %s\n", sourceIp, strerror(errno));
+		}
+	}
+	address.sin_port = htons(ARTNETPORT);
+	inet_aton(ip, &address.sin_addr);
+	
+	unsigned char packet[ARTNETDMXHEADERSIZE + ARTNETMAXCHANNELS];
+	memset(packet, 0, sizeof(packet));
+	memcpy(packet, "Art-Net", 8);
+	DataHelper::SetUint16(packet + 8, 0x5000); // OpDmx
+	packet[11] = ARTNETPROTVER;
+	packet[16] = (channels >> 8) & 0xFF;
+	packet[17] = channels & 0xFF;
+	
+	// Every frame in the pipe has an 8 byte message header and the SETCHANNELS header
+	int frameSize = 8 + SETCHANNELS_HEADERSIZE + channels;
+	
+	memset(result, 0, sizeof(*result));
+	unsigned char sequence = 0;
+	uint64_t pending = 0;
+	while(result->sent < (uint64_t)packets)
+	{
+		for(int i = 0; i < BENCH_BURSTSIZE && result->sent < (uint64_t)packets; i++)
+		{
+			sequence = sequence == 255 ? 1 : sequence + 1;
+			packet[12] = sequence;
+			packet[ARTNETDMXHEADERSIZE] = (unsigned char)result->sent;
+			if(sendto(sock, packet, ARTNETDMXHEADERSIZE + channels, 0,
+				(sockaddr *)&address, sizeof(address)) < 0)
+			{
+				fprintf(stderr, "Could not send packet: %s\n", strerror(errno));
+				break;
+			}
+			result->sent++;
+		}
+		
+		uint64_t wall = GetMonotonicTime();
+		uint64_t cpu = GetThreadCpuTime();
+		engine->Tick();
+		result->cpuTime += GetThreadCpuTime() - cpu;
+		result->wallTime += GetMonotonicTime() - wall;
+		
+		result->received += DrainPipe(pipes[0], frameSize, &pending);
+	}
+	
+	close(sock);
+	delete engine;
+	close(pipes[0]);
+	close(pipes[1]);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<std::string> engines;
+	const char *ip = "127.0.0.1";
+	const char *sourceIp = NULL;
+	int packets = 100000;
+	int channels = ARTNETMAXCHANNELS;
+	
+	int c;
+	while((c = getopt(argc, argv, "e:b:s:n:c:h")) != -1)
+	{
+		switch(c)
+		{
+		case 'e':
+			engines.push_back(optarg);
+			break;
+		case 'b':
+			ip = optarg;
+			break;
+		case 's':
+			sourceIp = optarg;
+			break;
+		case 'n':
+			packets = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			if(channels < 2 || channels > ARTNETMAXCHANNELS)
+				channels = ARTNETMAXCHANNELS;
+			break;
+		default:
+			printf("Usage %s [-e engine]... [-b bind_ip][-s source_ip][-n packets][-c channels]\n\n"
+				"\t-e engine: Engine to benchmark(native, libartnet), can be repeated\n"
+				"\t-b bind_ip: Ip address that the engine binds to and the packets are sent to\n"
+				"\t-s source_ip: Ip address that the packets are sent from,\n"
+				"\t\tlibartnet ignores packets that are sent from its own address\n"
+				"\t-n packets: Number of packets to send\n"
+				"\t-c channels: Number of channels in every packet\n", argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if(engines.empty())
+	{
+		engines.push_back("native");
+#ifdef HAVE_LIBARTNET
+		engines.push_back("libartnet");
+#endif
+	}
+	
+	printf("%-10s %10s %10s %14s %14s\n", "engine", "sent", "forwarded", "packets/s", "cpu/packet");
+	for(size_t i = 0; i < engines.size(); i++)
+	{
+		BenchResult result;
+		if(!RunBenchmark(engines[i], ip, sourceIp, packets, channels, &result))
+			continue;
+		// Engines can forward only the newest frame of a burst, so the rate is
+		// based on the packets that were handled
+		double rate = result.wallTime > 0 ? result.sent * 1e9 / result.wallTime : 0;
+		double cpu = result.sent > 0 ? result.cpuTime / 1000.0 / result.sent : 0;
+		printf("%-10s %10llu %10llu %14.0f %11.2fus\n", engines[i].c_str(),
+			(unsigned long long)result.sent, (unsigned long long)result.received, rate, cpu);
+	}
+	return 0;
+}
@@ -0,0 +1,46 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "logger.h"
+#include "stringhelper.h"
+#include "artnet.h"
+#include "libartnetengine.h"
+#include "artnetengine.h"
+
+ArtNetEngine *CreateArtNetEngine(std::string engine, std::string ip, MergeEngine *merge)
+{
+	engine = ToLower(engine);
+	if(engine == "libartnet")
+	{
+#ifdef HAVE_LIBARTNET
+		return new LibArtNetEngine(ip, merge);
+#else
+		Error("dmxd is compiled without libartnet support");
+		return NULL;
+#endif
+	}
+	if(engine != "native")
+	{
+		Warn("Unknown Art-Net engine \"%s\", using the native engine", engine.c_str());
+	}
+	return new ArtNet(ip, merge);
+}
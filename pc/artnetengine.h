@@ -0,0 +1,54 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _ARTNETENGINE_H_
+#define _ARTNETENGINE_H_
+
+#include <string>
+#include <stdint.h>
+#include "mergeengine.h"
+
+// Interface of an Art-Net node implementation
+// The node passes the received dmx data to the merge engine, which sends it to the dmx process
+class ArtNetEngine
+{
+public:
+	virtual ~ArtNetEngine() {}
+	
+	virtual bool IsValid() const = 0;
+	// Returns the socket of the node, it becomes readable when Tick has work to do
+	virtual int GetSocket() const = 0;
+	// Handle all received packets
+	virtual void Tick() = 0;
+	// Returns the time on the monotonic clock in ns at which HandleTimeouts must
+	// be called, 0 when no state expires
+	virtual uint64_t GetNextTimeout() const { return 0; }
+	// Expire the state that timed out because no packets were received
+	virtual void HandleTimeouts() {}
+	// Log the statistics of the node
+	virtual void ReportStatistics() {}
+};
+
+// Create the Art-Net engine with the given name(native, libartnet)
+// Returns NULL when the engine is not available
+ArtNetEngine *CreateArtNetEngine(std::string engine, std::string ip, MergeEngine *merge);
+
+#endif
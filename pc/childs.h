@@ -22,9 +22,12 @@ THE SOFTWARE.*/
 #ifndef _CHILDS_H_
 #define _CHILDS_H_
 
+#include "shareduniverse.h"
+
 extern int running;
 
-int dmxChild(int readfd, int writefd);
-int serverChild(int readfd, int writefd);
+// shared is NULL when the channel values are sent through the pipes
+int dmxChild(int readfd, int writefd, SharedUniverse *shared);
+int serverChild(int readfd, int writefd, SharedUniverse *shared);
 
 #endif
\ No newline at end of file
@@ -148,4 +148,36 @@ void DataHelper::SetInt16(unsigned char *data, int16_t val)
 void DataHelper::SetInt8(unsigned char *data, int8_t val)
 {
 	*data++ = (val>>0)&0xFF;
-}
\ No newline at end of file
+}
+
+uint32_t DataHelper::GetUint32BE(const unsigned char *data)
+{
+	const uint8_t *ptr = (uint8_t *)data;
+	uint32_t result = (*ptr++)<<24;
+	result |= (*ptr++)<<16;
+	result |= (*ptr++)<<8;
+	result |= *ptr++;
+	return result;
+}
+
+uint16_t DataHelper::GetUint16BE(const unsigned char *data)
+{
+	const uint8_t *ptr = (uint8_t *)data;
+	uint16_t result = (*ptr++)<<8;
+	result |= *ptr++;
+	return result;
+}
+
+void DataHelper::SetUint32BE(unsigned char *data, uint32_t val)
+{
+	*data++ = (val>>24)&0xFF;
+	*data++ = (val>>16)&0xFF;
+	*data++ = (val>>8)&0xFF;
+	*data++ = (val>>0)&0xFF;
+}
+
+void DataHelper::SetUint16BE(unsigned char *data, uint16_t val)
+{
+	*data++ = (val>>8)&0xFF;
+	*data++ = (val>>0)&0xFF;
+}
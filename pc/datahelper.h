@@ -42,6 +42,11 @@ public:
 	static void SetInt32(unsigned char *data, int32_t val);
 	static void SetInt16(unsigned char *data, int16_t val);
 	static void SetInt8(unsigned char *data, int8_t val);
+	// Big endian (network order) variants
+	static uint32_t GetUint32BE(const unsigned char *data);
+	static uint16_t GetUint16BE(const unsigned char *data);
+	static void SetUint32BE(unsigned char *data, uint32_t val);
+	static void SetUint16BE(unsigned char *data, uint16_t val);
 private:
 
 };
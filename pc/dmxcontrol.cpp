@@ -20,23 +20,33 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.*/
 
-#include <wiringPiSPI.h>
 #include <string.h>
 #include <unistd.h>
 #include "logger.h"
 #include "settings.h"
 #include "global.h"
+#include "stringhelper.h"
+#include "metrics.h"
 #include "dmxcontrol.h"
 
 DmxControl::DmxControl()
 {
-
+	mTransport = NULL;
+	mCommandCount = 0;
+	mTransferDelay = 0;
+	mCSChange = true;
+	mChannelCount = 0;
+	mChannels = NULL;
+	mDirty = NULL;
+	mBlockCount = 0;
+	mSentTransfers = 0;
 }
 
 DmxControl::~DmxControl()
 {
 	Close();
-	
+	delete[] mChannels;
+	delete[] mDirty;
 }
 
 int DmxControl::GetChannelCount()
@@ -46,21 +56,34 @@ int DmxControl::GetChannelCount()
 
 void DmxControl::UpdateChannels()
 {
-	for(int i = 0; i< mChannelCount; i+=8)
+	// The reply to a command is received during the next command, so every
+	// block is requested in one go followed by an ignore command
+	// The interface has at most 255 channels, so all commands fit
+	int first = mCommandCount;
+	for(int i = 0; i < mChannelCount; i += DMX_BLOCKSIZE)
 	{
-		// Get 8 channels from the interface
-		uint8_t values[8];
-		if(!GetDMXChannels(i + 1, values))
+		QueueCommand(0x02, i + 1); // Get channels command
+	}
+	QueueCommand(0x00, 0); // Ignore command
+	if(!SubmitCommands())
+	{
+		Error("Could not get current channel values from interface");
+		return;
+	}
+	for(int i = 0; i < mChannelCount; i += DMX_BLOCKSIZE)
+	{
+		uint8_t *reply = mCommands[first + i / DMX_BLOCKSIZE + 1];
+		if(reply[0] != 0x02)
 		{
 			Error("Could not get current channel values from interface");
 			continue;
 		}
 		// Write the values to the local buffer if it fits 
-		for(int j = 0; j<8; j++)
+		for(int j = 0; j < DMX_BLOCKSIZE; j++)
 		{
 			if(i+j >= mChannelCount)
 				break;
-			mChannels[i+j] = values[j];
+			mChannels[i+j] = reply[2+j];
 		}
 	}
 }
@@ -79,28 +102,38 @@ void DmxControl::RefreshChannels()
 		}
 		SetDMXChannels(i + 1, values);
 	}
+	memset(mDirty, 0, mBlockCount);
+	SubmitCommands();
 }
 
 void DmxControl::SetAll(uint8_t val)
 {
 	for(int i = 0; i < mChannelCount; i++)
 	{
-		mChannels[i] = val;
+		if(mChannels[i] != val)
+		{
+			mChannels[i] = val;
+			mDirty[i / DMX_BLOCKSIZE] |= 1 << (i % DMX_BLOCKSIZE);
+		}
 	}
-	RefreshChannels();
+	FlushChannels();
 }
 
 void DmxControl::SetChannel(int address, uint8_t value)
 {
-	mChannels[address-1] = value;
-	SetDMXChannel(address, value, 255, 0, 255, 0, 255, 0);
+	if(address < 1 || address > mChannelCount)
+		return;
+	DiffChannels(address - 1, &value, 1);
+	FlushChannels();
 }
 
 int DmxControl::GetChannels(int address, uint8_t *values, int size)
 {
-	if(address + size > mChannelCount)
+	if(address < 1 || address > mChannelCount)
+		return 0;
+	if(address - 1 + size > mChannelCount)
 	{
-		size = mChannelCount - address;
+		size = mChannelCount - address + 1;
 	}
 	memcpy(values, mChannels+address-1, size);
 	return size;
@@ -108,29 +141,172 @@ int DmxControl::GetChannels(int address, uint8_t *values, int size)
 
 int DmxControl::SetChannels(int address, uint8_t *values, int size)
 {
-	if(address + size > mChannelCount)
+	if(address < 1 || address > mChannelCount)
+		return 0;
+	if(address - 1 + size > mChannelCount)
 	{
-		size = mChannelCount - address;
+		size = mChannelCount - address + 1;
 	}
-	memcpy(mChannels + address-1, values, size);
-	RefreshChannels();
+	DiffChannels(address - 1, values, size);
+	FlushChannels();
 	return size;
 }
 
+uint64_t DmxControl::GetSentTransfers() const
+{
+	return mSentTransfers;
+}
+
+void DmxControl::DiffChannels(int index, const uint8_t *values, int size)
+{
+	for(int i = 0; i < size; i++)
+	{
+		int channel = index + i;
+		if(mChannels[channel] != values[i])
+		{
+			mChannels[channel] = values[i];
+			mDirty[channel / DMX_BLOCKSIZE] |= 1 << (channel % DMX_BLOCKSIZE);
+		}
+	}
+}
+
+void DmxControl::FlushChannels()
+{
+	// A block costs one transfer when it is sent with the set channels command
+	// and a quarter transfer per changed channel when it is sent with the set
+	// channel command. Sending the blocks with the most changes as dense blocks
+	// and packing the rest in set channel commands is optimal, so try every
+	// number of dense blocks in order of decreasing change count.
+	int blocksWithChanges[DMX_BLOCKSIZE + 1] = {0};
+	int forcedDense = 0;
+	int sparseChannels = 0;
+	for(int i = 0; i < mBlockCount; i++)
+	{
+		if(mDirty[i] == 0)
+			continue;
+		// The set channel command can't address the last channel
+		int lastChannel = i * DMX_BLOCKSIZE + 31 - __builtin_clz(mDirty[i]) + 1;
+		if(lastChannel >= mChannelCount)
+		{
+			forcedDense++;
+			continue;
+		}
+		int changes = __builtin_popcount(mDirty[i]);
+		blocksWithChanges[changes]++;
+		sparseChannels += changes;
+	}
+	
+	int bestCost = forcedDense + (sparseChannels + DMX_PAIRSPERTRANSFER - 1) / DMX_PAIRSPERTRANSFER;
+	// Blocks with at least this many changes are sent dense
+	int denseThreshold = DMX_BLOCKSIZE + 1;
+	int dense = forcedDense;
+	for(int changes = DMX_BLOCKSIZE; changes > 0; changes--)
+	{
+		if(blocksWithChanges[changes] == 0)
+			continue;
+		dense += blocksWithChanges[changes];
+		sparseChannels -= changes * blocksWithChanges[changes];
+		int cost = dense + (sparseChannels + DMX_PAIRSPERTRANSFER - 1) / DMX_PAIRSPERTRANSFER;
+		if(cost < bestCost)
+		{
+			bestCost = cost;
+			denseThreshold = changes;
+		}
+	}
+	
+	// Send the commands
+	int addresses[DMX_PAIRSPERTRANSFER];
+	uint8_t values[DMX_PAIRSPERTRANSFER];
+	int pairs = 0;
+	for(int i = 0; i < mBlockCount; i++)
+	{
+		uint8_t dirty = mDirty[i];
+		if(dirty == 0)
+			continue;
+		mDirty[i] = 0;
+		int first = i * DMX_BLOCKSIZE;
+		int lastChannel = first + 31 - __builtin_clz(dirty) + 1;
+		if(lastChannel >= mChannelCount || __builtin_popcount(dirty) >= denseThreshold)
+		{
+			uint8_t block[DMX_BLOCKSIZE] = {0};
+			for(int j = 0; j < DMX_BLOCKSIZE && first + j < mChannelCount; j++)
+			{
+				block[j] = mChannels[first + j];
+			}
+			SetDMXChannels(first + 1, block);
+			continue;
+		}
+		for(int j = 0; j < DMX_BLOCKSIZE; j++)
+		{
+			if(!(dirty & (1 << j)))
+				continue;
+			addresses[pairs] = first + j + 1;
+			values[pairs] = mChannels[first + j];
+			pairs++;
+			if(pairs == DMX_PAIRSPERTRANSFER)
+			{
+				SetDMXChannel(addresses[0], values[0], addresses[1], values[1],
+					addresses[2], values[2], addresses[3], values[3]);
+				pairs = 0;
+			}
+		}
+	}
+	if(pairs > 0)
+	{
+		// The interface ignores pairs with address 255
+		for(int j = pairs; j < DMX_PAIRSPERTRANSFER; j++)
+		{
+			addresses[j] = 255;
+			values[j] = 0;
+		}
+		SetDMXChannel(addresses[0], values[0], addresses[1], values[1],
+			addresses[2], values[2], addresses[3], values[3]);
+	}
+	SubmitCommands();
+}
+
 bool DmxControl::Open()
+{
+	return Open(Settings::GetSPIPort());
+}
+
+bool DmxControl::Open(int port)
 {
 	// Get the settings
-	int port = Settings::GetSPIPort();
 	int speed = Settings::GetSPISpeed();
+	std::string backend = ToLower(Settings::GetSPIBackend());
+	mTransferDelay = Settings::GetSPITransferDelay();
+	mCSChange = ToLower(Settings::GetSPICSChange()) != "off";
 	
-	// Initialize the SPI library
+	// Initialize the SPI transport
 	Debug("opening SPI port");
-	mFd = wiringPiSPISetup(port, speed*1000);
-	if(mFd == -1)
+	mTransport = CreateSpiTransport(backend);
+	if(mTransport != NULL && !mTransport->Open(port, speed))
 	{
-		Error("Could not open SPI port %d with speed %dkHz: %s", port, speed, strerror(errno));
+		delete mTransport;
+		mTransport = NULL;
+		if(backend == "spidev")
+		{
+			Warn("Falling back to wiringPi for SPI port %d", port);
+			mTransport = CreateSpiTransport("wiringpi");
+			if(mTransport != NULL && !mTransport->Open(port, speed))
+			{
+				delete mTransport;
+				mTransport = NULL;
+			}
+		}
+	}
+	if(mTransport == NULL)
+	{
+		Error("Could not open SPI port %d with speed %dkHz", port, speed);
 		return false;
 	}
+	return Open(mTransport);
+}
+
+bool DmxControl::Open(SpiTransport *transport)
+{
+	mTransport = transport;
 	
 	// Get information from the interface
 	if(!GetDMXInfo(&mChannelCount))
@@ -142,52 +318,86 @@ bool DmxControl::Open()
 	
 	// Get the current channel values
 	mChannels = new uint8_t[mChannelCount];
+	mBlockCount = (mChannelCount + DMX_BLOCKSIZE - 1) / DMX_BLOCKSIZE;
+	mDirty = new uint8_t[mBlockCount];
+	memset(mDirty, 0, mBlockCount);
 	UpdateChannels();
 	return true;
 }
 
 void DmxControl::Close()
 {
-	if(mFd != -1)
-		close(mFd);
+	if(mTransport != NULL)
+	{
+		mTransport->Close();
+		delete mTransport;
+		mTransport = NULL;
+	}
 }
 
-bool DmxControl::GetDMXInfo(int *channels)
+uint8_t *DmxControl::QueueCommand(uint8_t command, uint8_t address)
 {
-//	Debug("DmxInfo");
-	uint8_t buffer[10] = {0x04, 0x00}; // Get Info command
-	wiringPiSPIDataRW(Settings::GetSPIPort(), buffer, sizeof(buffer)); // Send commando, result is garbage
-//	Debug("SPIBuffer: %02x, %02x, %02x, %02x, %02x, %02x, %02x, %02x %02x %02x", buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7], buffer[8], buffer[9]);
-	memset(buffer, 0, 10); // Ignore command
-	wiringPiSPIDataRW(Settings::GetSPIPort(), buffer, sizeof(buffer)); // Send Ignore command returns the result
-//	Debug("SPIBuffer: %02x, %02x, %02x, %02x, %02x, %02x, %02x, %02x %02x %02x", buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7], buffer[8], buffer[9]);
-	if(buffer[0] == 4)
+	if(mCommandCount == DMX_MAXCOMMANDS)
 	{
-		if(channels)
-			*channels = buffer[1];
-		return true;
+		SubmitCommands();
 	}
-	return false;
+	uint8_t *buffer = mCommands[mCommandCount];
+	memset(buffer, 0, DMX_COMMANDSIZE);
+	buffer[0] = command;
+	buffer[1] = address;
+	SpiTransfer &transfer = mTransfers[mCommandCount];
+	transfer.buffer = buffer;
+	transfer.length = DMX_COMMANDSIZE;
+	transfer.delayUs = mTransferDelay;
+	transfer.csChange = mCSChange;
+	mCommandCount++;
+	return buffer;
 }
 
-bool DmxControl::GetDMXChannels(int address, uint8_t *channels)
+bool DmxControl::SubmitCommands()
 {
-	//Debug("Get DMX channels");
-	uint8_t buffer[10] = {0x02, (uint8_t) address, 0}; // Get Info command
-	wiringPiSPIDataRW(Settings::GetSPIPort(), buffer, sizeof(buffer)); // Send commando, result is garbage
-	//Debug("SPIBuffer: %02x, %02x, %02x, %02x, %02x, %02x, %02x, %02x %02x %02x", buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7], buffer[8], buffer[9]);
-	memset(buffer, 0, 10); // Ignore command
-	wiringPiSPIDataRW(Settings::GetSPIPort(), buffer, sizeof(buffer)); // Send Ignore command returns the result
-	//Debug("SPIBuffer: %02x, %02x, %02x, %02x, %02x, %02x, %02x, %02x %02x %02x", buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7], buffer[8], buffer[9]);
-	if(buffer[0] == 2)
+	if(mCommandCount == 0)
+		return true;
+	int count = mCommandCount;
+	mCommandCount = 0;
+	mSentTransfers += count;
+	// Count the commands of the batch first, so there are few atomic operations
+	int commands[METRIC_SPI_COMMANDCOUNT] = {0};
+	int bytes[METRIC_SPI_COMMANDCOUNT] = {0};
+	for(int i = 0; i < count; i++)
 	{
-		if(channels)
+		uint8_t command = mCommands[i][0];
+		if(command < METRIC_SPI_COMMANDCOUNT)
 		{
-			for(int i = 0; i<8; i++)
-			{
-				channels[i] = buffer[2+i];
-			}
+			commands[command]++;
+			bytes[command] += mTransfers[i].length;
 		}
+	}
+	for(int i = 0; i < METRIC_SPI_COMMANDCOUNT; i++)
+	{
+		if(commands[i] == 0)
+			continue;
+		Metrics::Add((Metric_t)(METRIC_SPI_COMMANDS + i), commands[i]);
+		Metrics::Add((Metric_t)(METRIC_SPI_BYTES + i), bytes[i]);
+	}
+	if(!mTransport->Transfer(mTransfers, count))
+	{
+		Metrics::Add(METRIC_SPI_ERRORS);
+		return false;
+	}
+	return true;
+}
+
+bool DmxControl::GetDMXInfo(int *channels)
+{
+	QueueCommand(0x04, 0); // Get Info command
+	uint8_t *reply = QueueCommand(0x00, 0); // Ignore command returns the result
+	if(!SubmitCommands())
+		return false;
+	if(reply[0] == 4)
+	{
+		if(channels)
+			*channels = reply[1];
 		return true;
 	}
 	return false;
@@ -195,7 +405,7 @@ bool DmxControl::GetDMXChannels(int address, uint8_t *channels)
 
 void DmxControl::SetDMXChannels(int address, uint8_t *channels)
 {
-	uint8_t buffer[10] = {0x03, (uint8_t) address, 0}; // Get Info command
+	uint8_t *buffer = QueueCommand(0x03, address); // Set channels command
 	if(channels)
 	{
 		for(int i = 0; i<8; i++)
@@ -203,12 +413,16 @@ void DmxControl::SetDMXChannels(int address, uint8_t *channels)
 			buffer[2+i] = channels[i];
 		}
 	}
-	//Debug("SPIBuffer: %02x, %02x, %02x, %02x, %02x, %02x, %02x, %02x %02x %02x", buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7], buffer[8], buffer[9]);
-	wiringPiSPIDataRW(Settings::GetSPIPort(), buffer, sizeof(buffer)); // Send commando, result is garbage
 }
 
 void DmxControl::SetDMXChannel(int address1, uint8_t channel1, int address2, uint8_t channel2,int address3, uint8_t channel3,int address4, uint8_t channel4)
 {
-	uint8_t buffer[10] = {0x01, (uint8_t) address1, channel1, (uint8_t) address2, channel2, (uint8_t) address3, channel3, (uint8_t) address4, channel4, 0}; // Set Channel
-	wiringPiSPIDataRW(Settings::GetSPIPort(), buffer, sizeof(buffer)); // Send commando, result is garbage
-}
\ No newline at end of file
+	uint8_t *buffer = QueueCommand(0x01, address1); // Set channel command
+	buffer[2] = channel1;
+	buffer[3] = address2;
+	buffer[4] = channel2;
+	buffer[5] = address3;
+	buffer[6] = channel3;
+	buffer[7] = address4;
+	buffer[8] = channel4;
+}
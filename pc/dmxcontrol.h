@@ -23,6 +23,16 @@ THE SOFTWARE.*/
 #define _DMXCONTROL_H_
 
 #include <stdint.h>
+#include "spitransport.h"
+
+// Number of channels in a block of the set channels command (0x03)
+#define DMX_BLOCKSIZE 8
+// Number of channels in a set channel command (0x01)
+#define DMX_PAIRSPERTRANSFER 4
+// Size of a command of the interface
+#define DMX_COMMANDSIZE 10
+// Number of commands that are sent to the interface at once
+#define DMX_MAXCOMMANDS 64
 
 class DmxControl
 {
@@ -30,7 +40,12 @@ public:
 	DmxControl();
 	~DmxControl();
 	
+	// Open the SPI transport that is selected in the settings
 	bool Open();
+	// Open the SPI transport that is selected in the settings on the given SPI port
+	bool Open(int port);
+	// Use the given transport, DmxControl takes ownership of it
+	bool Open(SpiTransport *transport);
 	void Close();
 	
 	int GetChannelCount();
@@ -41,17 +56,42 @@ public:
 	void SetChannel(int address, uint8_t value);
 	int GetChannels(int address, uint8_t *values, int size);
 	int SetChannels(int address, uint8_t *values, int size);
+	// Number of commands that were sent to the interface
+	uint64_t GetSentTransfers() const;
 	
 	
 private:
+	// Write the channels that changed since the last flush to the interface
+	// using the cheapest mix of set channel and set channels commands
+	void FlushChannels();
+	// Mark the channels that differ from the current values as dirty and
+	// copy the new values
+	void DiffChannels(int index, const uint8_t *values, int size);
+
+	// Add a command to the commands that are sent by SubmitCommands
+	// Returns the buffer of the command, it contains the reply of the previous
+	// command after the commands are sent
+	uint8_t *QueueCommand(uint8_t command, uint8_t address);
+	// Send all queued commands to the interface
+	bool SubmitCommands();
+	
 	bool GetDMXInfo(int *channels);
-	bool GetDMXChannels(int address, uint8_t *channels);
 	void SetDMXChannels(int address, uint8_t *channels);
 	void SetDMXChannel(int address1, uint8_t channel1, int address2, uint8_t channel2,int address3, uint8_t channel3,int address4, uint8_t channel4);
 	
-	int mFd;
+	SpiTransport *mTransport;
+	uint8_t mCommands[DMX_MAXCOMMANDS][DMX_COMMANDSIZE];
+	SpiTransfer mTransfers[DMX_MAXCOMMANDS];
+	int mCommandCount;
+	int mTransferDelay;
+	bool mCSChange;
+	
 	int mChannelCount;
 	uint8_t *mChannels;
+	// One bit per channel for every block of DMX_BLOCKSIZE channels
+	uint8_t *mDirty;
+	int mBlockCount;
+	uint64_t mSentTransfers;
 };
 
 
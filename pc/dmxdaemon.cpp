@@ -22,82 +22,269 @@ THE SOFTWARE.*/
 
 #include <unistd.h>
 #include <stdint.h>
+#include <vector>
+#include <sys/epoll.h>
 #include "logger.h"
 #include "settings.h"
 #include "global.h"
 #include "ipc.h"
 #include "childs.h"
+#include "eventloop.h"
 #include "datahelper.h"
 #include "dmxcontrol.h"
+#include "outputworker.h"
+#include "outputconfig.h"
 #include "messages.h"
 #include "stringhelper.h"
+#include "timehelper.h"
+#include "latencyhistogram.h"
+#include "realtimehelper.h"
+
+// Part of the stack of the message loop that is faulted in before the memory is locked
+#define DMXCHILD_PREFAULTSIZE (64 * 1024)
 
 using namespace std;
 
-int dmxChild(int readfd, int writefd)
+struct DmxChildContext {
+	IPC *ipc;
+	// One worker for every output, the index is the output
+	std::vector<OutputWorker *> workers;
+	EventLoop *loop;
+	SharedUniverse *shared;
+	uint64_t reportedCoalesced;
+	// Buffer for channel values that are sent to the server
+	std::vector<uint8_t> values;
+	// Time from receiving a frame in the server to receiving it in this process
+	LatencyHistogram receiveLatency;
+};
+
+// Handle all messages that are received from the server
+// Requests without an output refer to the first output
+static void HandleMessages(DmxChildContext *context)
+{
+	IPC *ipc = context->ipc;
+	std::vector<OutputWorker *> &workers = context->workers;
+	std::vector<uint8_t> &values = context->values;
+	uint64_t received = 0;
+	const IPCMessage *message;
+	while((message = ipc->GetMessage()) != NULL)
+	{
+		unsigned char response[4];
+		unsigned char *data = (unsigned char *)message->GetData();
+		int output;
+		uint64_t stamp;
+		//Debug("Received message: %s", message->ToString().c_str());
+		switch(message->GetType())
+		{
+		case MSG_GETINFO:
+			DataHelper::SetInt32(response, workers[0]->GetChannelCount());
+			ipc->SendMessage(MSG_GETINFORESPONSE, sizeof(response), response);
+			break;
+		case MSG_GETCHANNELS:
+			values.resize(workers[0]->GetChannelCount());
+			workers[0]->GetChannels(1, values.data(), values.size());
+			ipc->SendMessage(MSG_GETCHANNELSRESPONSE, values.size(), values.data());
+			break;
+		case MSG_SETCHANNELS:
+			if(message->GetDataSize() < SETCHANNELS_HEADERSIZE)
+			{
+				Warn("Received channels message of %d bytes, it is too short", message->GetDataSize());
+				break;
+			}
+			output = DataHelper::GetInt32(data);
+			if(output < 0 || output >= (int)workers.size())
+			{
+				Warn("Received channels for unknown output %d", output);
+				break;
+			}
+			stamp = DataHelper::GetUint64(data + 8);
+			// The messages of one read arrived at the same time
+			if(received == 0)
+				received = GetRealTime();
+			context->receiveLatency.AddSince(stamp, received);
+			workers[output]->SetChannels(DataHelper::GetInt32(data + 4), 
+				data + SETCHANNELS_HEADERSIZE, message->GetDataSize() - SETCHANNELS_HEADERSIZE,
+				stamp, received);
+			break;
+		case MSG_SETCHANNEL:
+			workers[0]->SetChannel(DataHelper::GetInt32(data),
+				DataHelper::GetUint8(data + 4));
+			break;
+		case MSG_SETALL:
+			for(size_t i = 0; i < workers.size(); i++)
+			{
+				workers[i]->SetAll(DataHelper::GetInt8(data));
+			}
+			break;
+		}
+	}
+}
+
+// Called by the event loop when the IPC pipe is readable
+static void HandleIpcEvent(int fd, uint32_t events, void *data)
+{
+	DmxChildContext *context = (DmxChildContext *)data;
+	context->ipc->Tick();
+	HandleMessages(context);
+	if((events & (EPOLLHUP | EPOLLERR)) && !(events & EPOLLIN))
+	{
+		Error("IPC channel closed");
+		context->loop->Stop();
+	}
+}
+
+// Called by the event loop when the shared universe is updated
+static void HandleSharedEvent(int fd, uint32_t events, void *data)
+{
+	DmxChildContext *context = (DmxChildContext *)data;
+	SharedUniverse *shared = context->shared;
+	uint8_t values[SHAREDUNIVERSE_MAXCHANNELS];
+	int address;
+	int count;
+	uint64_t stamp;
+	uint64_t received = GetRealTime();
+	shared->ClearDoorbell();
+	for(int i = 0; i < shared->GetOutputCount() && i < (int)context->workers.size(); i++)
+	{
+		if(shared->Read(i, &address, &count, values, &stamp))
+		{
+			context->receiveLatency.AddSince(stamp, received);
+			context->workers[i]->SetChannels(address, values, count, stamp, received);
+		}
+	}
+}
+
+// Called periodically to report the statistics
+static void HandleStatisticsTimer(uint64_t expirations, void *data)
+{
+	DmxChildContext *context = (DmxChildContext *)data;
+	context->receiveLatency.Report("Receive to dmx process latency");
+	uint64_t coalesced = context->ipc->GetCoalescedMessages();
+	if(context->shared != NULL)
+		coalesced += context->shared->GetSkippedFrames();
+	for(size_t i = 0; i < context->workers.size(); i++)
+	{
+		coalesced += context->workers[i]->GetSkippedFrames();
+		context->workers[i]->ReportStatistics();
+	}
+	if(coalesced != context->reportedCoalesced)
+	{
+		Inform("%llu superseded frames were not written to the interface",
+			(unsigned long long)(coalesced - context->reportedCoalesced));
+		context->reportedCoalesced = coalesced;
+	}
+	context->ipc->ReportQueueStatistics("IPC queue to the server");
+}
+
+// Stop the output workers and close their interfaces
+static void DeleteWorkers(std::vector<OutputWorker *> &workers)
+{
+	for(size_t i = 0; i < workers.size(); i++)
+	{
+		delete workers[i];
+	}
+	workers.clear();
+}
+
+int dmxChild(int readfd, int writefd, SharedUniverse *shared)
 {
 	
 	// Initialize IPC
 	IPC *ipc = new IPC(readfd, writefd);
+	DmxChildContext context;
+	context.ipc = ipc;
+	context.loop = NULL;
+	context.shared = shared;
+	context.reportedCoalesced = 0;
 	
-	// Initialize Dmx Control
-	DmxControl control;
-	if(!control.Open())
+	// Initialize Dmx Control for every output
+	std::vector<OutputConfig> outputs = GetOutputConfigs();
+	int rate = Settings::GetOutputRate();
+	if(rate > 0)
+	{
+		Inform("Writing the outputs at %d Hz", rate);
+	}
+	for(size_t i = 0; i < outputs.size(); i++)
+	{
+		DmxControl *control = new DmxControl();
+		if(!control->Open(outputs[i].spiPort))
+		{
+			delete control;
+			DeleteWorkers(context.workers);
+			delete ipc;
+			return EXIT_COULD_NOT_START_SPI;
+		}
+		context.workers.push_back(new OutputWorker(control, i, rate));
+	}
+	
+	bool on = ToLower(Settings::GetInitialState()) == "on";
+	int priority = Settings::GetOutputPriority();
+	int cpu = Settings::GetOutputCpu();
+	if(priority > 0)
+	{
+		Inform("Running the outputs with real-time priority %d", priority);
+	}
+	if(cpu >= 0)
+	{
+		Inform("Running the outputs on cpu %d", cpu);
+	}
+	for(size_t i = 0; i < context.workers.size(); i++)
 	{
-		return EXIT_COULD_NOT_START_SPI;
+		context.workers[i]->SetAll(on ? 255 : 0);
+		context.workers[i]->SetRealtime(priority, cpu, Settings::GetWakeupTest());
+		if(!context.workers[i]->Start())
+		{
+			DeleteWorkers(context.workers);
+			delete ipc;
+			return EXIT_COULD_NOT_CREATE_CHILDS;
+		}
 	}
 	
-	if(ToLower(Settings::GetInitialState()) == "on")
+	// Wait for messages from the server instead of polling the pipe
+	EventLoop loop;
+	context.loop = &loop;
+	if(!loop.IsValid())
+	{
+		DeleteWorkers(context.workers);
+		delete ipc;
+		return EXIT_COULD_NOT_CREATE_CHILDS;
+	}
+	ipc->SetEventLoop(&loop);
+	ipc->SetQueueLimit(Settings::GetIPCQueueSize(), ParseDropPolicy(Settings::GetIPCDropPolicy()));
+	ipc->SetQueueMetric(METRIC_DMX_IPC_QUEUE);
+	loop.SetMetrics(METRIC_DMX_LOOP_ITERATIONS, METRIC_DMX_LOOP_TIME);
+	context.values.reserve(context.workers[0]->GetChannelCount());
+	if(!loop.AddFd(readfd, EPOLLIN, HandleIpcEvent, &context))
+	{
+		DeleteWorkers(context.workers);
+		delete ipc;
+		return EXIT_COULD_NOT_CREATE_CHILDS;
+	}
+	if(shared != NULL &&
+		!loop.AddFd(shared->GetDoorbellFd(), EPOLLIN, HandleSharedEvent, &context))
 	{
-		control.SetAll(255);
-	} else {
-		control.SetAll(0);
-	} 
+		DeleteWorkers(context.workers);
+		delete ipc;
+		return EXIT_COULD_NOT_CREATE_CHILDS;
+	}
+	if(Settings::GetStatisticsInterval() > 0)
+	{
+		loop.AddTimer(Settings::GetStatisticsInterval() * 1000, HandleStatisticsTimer, &context);
+	}
 	
-	while(running)
+	// All buffers exist now, fault them in and keep them in memory
+	if(ToLower(Settings::GetLockMemory()) == "on")
 	{
-		ipc->Tick();
-		while(ipc->GetAvailableMessages() > 0)
+		PrefaultStack(DMXCHILD_PREFAULTSIZE);
+		if(LockMemory())
 		{
-			IPCMessage *message;
-			if((message = ipc->GetMessage()) != NULL)
-			{
-				IPCMessage *response;
-				uint8_t *values;
-				//Debug("Received message: %s", message->ToString().c_str());
-				switch(message->GetType())
-				{
-				case MSG_GETINFO:
-					response = GetInfoResponse(control.GetChannelCount());
-					ipc->SendMessage(*response);
-					delete response;
-					break;
-				case MSG_GETCHANNELS:
-					values = new uint8_t[control.GetChannelCount()];
-					control.GetChannels(1, values, control.GetChannelCount());
-					response = GetChannelsResponse(control.GetChannelCount(), values);
-					ipc->SendMessage(*response);
-					delete response;
-					break;
-				case MSG_SETCHANNELS:
-					control.SetChannels(DataHelper::GetInt32((unsigned char *)message->GetData()), 
-						(unsigned char *)message->GetData() + 4, 
-						message->GetDataSize()-4);
-					break;
-				case MSG_SETCHANNEL:
-					control.SetChannel(DataHelper::GetInt32((unsigned char *)message->GetData()),
-						DataHelper::GetUint8((unsigned char *)message->GetData()+4));
-					break;
-				case MSG_SETALL:
-					control.SetAll(DataHelper::GetInt8((unsigned char *)message->GetData()));
-					break;
-				}
-				delete message;
-			}
+			Inform("Locked the memory of the dmx process");
 		}
-		usleep(1000*15); // sleep for 15ms
 	}
 	
+	loop.Run(&running);
+	
+	DeleteWorkers(context.workers);
 	if(ipc != NULL)
 		delete ipc;
 	
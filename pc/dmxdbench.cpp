@@ -0,0 +1,514 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+// End-to-end benchmark of a running dmxd
+// Sends Art-Net OpDmx frames over the loopback interface to the daemon and
+// receives the channel values from the SPI simulator of the daemon. Every
+// frame carries a frame number in the first two channels, so the time
+// between sending a frame and the frame reaching the simulated interface can
+// be measured. The daemon must be started with SPIBackend = simulator and
+// SimulatorTrace set to the trace socket of the benchmark. To benchmark
+// several universes the daemon must output each of them, see Outputs.
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "datahelper.h"
+#include "artnet.h"
+#include "timehelper.h"
+#include "simulatortransport.h"
+#include "sacnreceiver.h"
+
+// Number of frame numbers, a frame number is stored in two channels
+#define BENCH_FRAMENUMBERS 65536
+// Time to wait for the last frames after sending stopped
+#define BENCH_DRAINTIME 500000000LL
+// sACN universe of the synchronization packets
+#define BENCH_SACNSYNCUNIVERSE 63999
+
+struct BenchOptions {
+	const char *ip;
+	const char *trace;
+	int universes;
+	int firstUniverse;
+	double rate;
+	double duration;
+	int channels;
+	double density;
+	int burst;
+	bool sync;
+	bool sacn;
+};
+
+// Identifies the benchmark as sACN source
+static const unsigned char BenchCid[16] = {
+	'd', 'm', 'x', 'd', '-', 'b', 'e', 'n', 'c', 'h', 0, 0, 0, 0, 0, 1
+};
+
+struct BenchState {
+	// Send time of every frame number of every universe, 0 when the
+	// frame is not sent or already received
+	std::vector<std::vector<int64_t> > sendTimes;
+	std::vector<int64_t> latencies;
+	uint64_t sent;
+	uint64_t traced;
+	uint64_t received;
+	uint64_t lastFrame;
+};
+
+// Sum of the user and system time in clock ticks of all processes with the given name
+static uint64_t GetProcessCpuTicks(const char *name)
+{
+	uint64_t ticks = 0;
+	DIR *dir = opendir("/proc");
+	if(dir == NULL)
+		return 0;
+	struct dirent *entry;
+	while((entry = readdir(dir)) != NULL)
+	{
+		if(entry->d_name[0] < '0' || entry->d_name[0] > '9')
+			continue;
+		char path[300];
+		snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+		FILE *file = fopen(path, "r");
+		if(file == NULL)
+			continue;
+		char buffer[1024];
+		size_t len = fread(buffer, 1, sizeof(buffer) - 1, file);
+		fclose(file);
+		buffer[len] = '\0';
+		// The name is between parentheses and can contain spaces
+		char *start = strchr(buffer, '(');
+		char *end = strrchr(buffer, ')');
+		if(start == NULL || end == NULL)
+			continue;
+		*end = '\0';
+		if(strcmp(start + 1, name) != 0)
+			continue;
+		unsigned long utime, stime;
+		if(sscanf(end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) == 2)
+			ticks += utime + stime;
+	}
+	closedir(dir);
+	return ticks;
+}
+
+static uint64_t GetProcessCpuTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return TimespecToNs(ts);
+}
+
+static void SleepUntil(int64_t time)
+{
+	struct timespec ts;
+	ts.tv_sec = time / 1000000000LL;
+	ts.tv_nsec = time % 1000000000LL;
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static uint32_t Random(uint32_t *state)
+{
+	// xorshift32
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// Handle the traces that are received from the simulator
+static void ReceiveTraces(int sock, BenchState *state)
+{
+	SimulatorTrace trace;
+	ssize_t len;
+	while((len = recv(sock, &trace, sizeof(trace), MSG_DONTWAIT)) == sizeof(trace))
+	{
+		state->traced++;
+		int frame = (trace.channels[0] << 8) | trace.channels[1];
+		// Channel 3 contains the universe
+		int universe = trace.channels[2];
+		if(universe >= (int)state->sendTimes.size())
+			continue;
+		std::vector<int64_t> &sendTimes = state->sendTimes[universe];
+		if(sendTimes[frame] == 0)
+			continue;
+		state->latencies.push_back(trace.time - sendTimes[frame]);
+		sendTimes[frame] = 0;
+		state->received++;
+	}
+}
+
+static int CreateTraceSocket(const char *path)
+{
+	int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if(sock < 0)
+	{
+		fprintf(stderr, "Could not create trace socket: %s\n", strerror(errno));
+		return -1;
+	}
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	unlink(path);
+	if(bind(sock, (sockaddr *)&address, sizeof(address)) < 0)
+	{
+		fprintf(stderr, "Could not bind trace socket to %s: %s\n", path, strerror(errno));
+		close(sock);
+		return -1;
+	}
+	// The daemon runs as another user
+	chmod(path, 0666);
+	int size = 4 * 1024 * 1024;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	return sock;
+}
+
+static int64_t Percentile(const std::vector<int64_t> &sorted, double percentile)
+{
+	if(sorted.empty())
+		return 0;
+	size_t index = (size_t)(percentile / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+// Create an OpDmx packet
+static void CreateArtNetPacket(int portAddress, int channels, std::vector<unsigned char> *packet)
+{
+	packet->assign(ARTNETDMXHEADERSIZE + channels, 0);
+	unsigned char *p = &(*packet)[0];
+	memcpy(p, "Art-Net", 8);
+	DataHelper::SetUint16(p + 8, 0x5000); // OpDmx
+	p[11] = ARTNETPROTVER;
+	p[14] = portAddress & 0xFF;
+	p[15] = (portAddress >> 8) & 0x7F;
+	p[16] = (channels >> 8) & 0xFF;
+	p[17] = channels & 0xFF;
+}
+
+// Create an ArtSync packet
+static void CreateArtNetSyncPacket(std::vector<unsigned char> *packet)
+{
+	packet->assign(ARTNETSYNCSIZE, 0);
+	unsigned char *p = &(*packet)[0];
+	memcpy(p, "Art-Net", 8);
+	DataHelper::SetUint16(p + 8, 0x5200); // OpSync
+	p[11] = ARTNETPROTVER;
+}
+
+// Fill in the root layer of an sACN packet
+static void CreateSacnRootLayer(unsigned char *p, int size, uint32_t vector)
+{
+	static const char identifier[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+	DataHelper::SetUint16BE(p, 0x0010);
+	memcpy(p + 4, identifier, sizeof(identifier));
+	DataHelper::SetUint16BE(p + 16, 0x7000 | (size - 16));
+	DataHelper::SetUint32BE(p + 18, vector);
+	memcpy(p + 22, BenchCid, sizeof(BenchCid));
+}
+
+// Create an sACN data packet
+static void CreateSacnPacket(int universe, int channels, int syncAddress, std::vector<unsigned char> *packet)
+{
+	int size = SACNDATAHEADERSIZE + channels;
+	packet->assign(size, 0);
+	unsigned char *p = &(*packet)[0];
+	CreateSacnRootLayer(p, size, 0x00000004);
+	DataHelper::SetUint16BE(p + 38, 0x7000 | (size - 38));
+	DataHelper::SetUint32BE(p + 40, 0x00000002);
+	strcpy((char *)p + 44, "dmxd-bench");
+	p[108] = 100; // Priority
+	DataHelper::SetUint16BE(p + 109, syncAddress);
+	DataHelper::SetUint16BE(p + 113, universe);
+	DataHelper::SetUint16BE(p + 115, 0x7000 | (size - 115));
+	p[117] = 0x02;
+	p[118] = 0xA1;
+	DataHelper::SetUint16BE(p + 121, 1);
+	DataHelper::SetUint16BE(p + 123, channels + 1);
+}
+
+// Create an sACN synchronization packet
+static void CreateSacnSyncPacket(int syncAddress, std::vector<unsigned char> *packet)
+{
+	packet->assign(SACNSYNCSIZE, 0);
+	unsigned char *p = &(*packet)[0];
+	CreateSacnRootLayer(p, SACNSYNCSIZE, 0x00000008);
+	DataHelper::SetUint16BE(p + 38, 0x7000 | (SACNSYNCSIZE - 38));
+	DataHelper::SetUint32BE(p + 40, 0x00000001);
+	DataHelper::SetUint16BE(p + 45, syncAddress);
+}
+
+static bool RunBenchmark(const BenchOptions &options)
+{
+	int traceSock = CreateTraceSocket(options.trace);
+	if(traceSock < 0)
+		return false;
+	
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(options.sacn ? SACNPORT : ARTNETPORT);
+	inet_aton(options.ip, &address.sin_addr);
+	// sACN is sent to the multicast groups of the universes on the interface of the daemon
+	if(options.sacn)
+	{
+		setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &address.sin_addr, sizeof(address.sin_addr));
+	}
+	
+	// One packet per universe, channel 3 contains the index of the universe
+	// sACN uses universe port-address + 1, like the auto setting of the daemon
+	std::vector<std::vector<unsigned char> > packets(options.universes);
+	std::vector<struct sockaddr_in> addresses(options.universes, address);
+	int headerSize = options.sacn ? SACNDATAHEADERSIZE : ARTNETDMXHEADERSIZE;
+	int sequenceOffset = options.sacn ? 111 : 12;
+	for(int u = 0; u < options.universes; u++)
+	{
+		int portAddress = options.firstUniverse + u;
+		if(options.sacn)
+		{
+			CreateSacnPacket(portAddress + 1, options.channels,
+				options.sync ? BENCH_SACNSYNCUNIVERSE : 0, &packets[u]);
+			addresses[u].sin_addr.s_addr = GetSacnMulticastAddress(portAddress + 1);
+		} else {
+			CreateArtNetPacket(portAddress, options.channels, &packets[u]);
+		}
+		packets[u][headerSize + 2] = u;
+	}
+	
+	// Synchronization packet that is sent after the frames of all universes
+	std::vector<unsigned char> syncPacket;
+	struct sockaddr_in syncAddress = address;
+	if(options.sacn)
+	{
+		CreateSacnSyncPacket(BENCH_SACNSYNCUNIVERSE, &syncPacket);
+		syncAddress.sin_addr.s_addr = GetSacnMulticastAddress(BENCH_SACNSYNCUNIVERSE);
+	} else {
+		CreateArtNetSyncPacket(&syncPacket);
+	}
+	
+	BenchState state;
+	state.sendTimes.assign(options.universes, std::vector<int64_t>(BENCH_FRAMENUMBERS, 0));
+	state.latencies.reserve(options.rate * options.duration * options.universes + 1);
+	state.sent = 0;
+	state.traced = 0;
+	state.received = 0;
+	state.lastFrame = 0;
+	
+	uint32_t random = 0x12345678;
+	int changes = (int)(options.density * (options.channels - 3) + 0.5);
+	int64_t interval = (int64_t)(1e9 * options.burst / options.rate);
+	uint64_t frames = (uint64_t)(options.rate * options.duration);
+	unsigned char sequence = 0;
+	uint64_t frame = 0;
+	
+	long ticksPerSecond = sysconf(_SC_CLK_TCK);
+	uint64_t daemonTicks = GetProcessCpuTicks("dmxd");
+	uint64_t benchCpu = GetProcessCpuTime();
+	int64_t start = GetMonotonicTime();
+	int64_t next = start;
+	while(frame < frames)
+	{
+		// Wait for the next burst while handling the traces
+		for(;;)
+		{
+			int64_t now = GetMonotonicTime();
+			if(now >= next)
+				break;
+			struct pollfd fd = {traceSock, POLLIN, 0};
+			int timeout = (int)((next - now) / 1000000);
+			if(timeout == 0)
+			{
+				ReceiveTraces(traceSock, &state);
+				SleepUntil(next);
+				break;
+			}
+			if(poll(&fd, 1, timeout) > 0)
+				ReceiveTraces(traceSock, &state);
+		}
+		next += interval;
+		
+		for(int b = 0; b < options.burst && frame < frames; b++, frame++)
+		{
+			sequence = sequence == 255 ? 1 : sequence + 1;
+			int number = frame % BENCH_FRAMENUMBERS;
+			for(int u = 0; u < options.universes; u++)
+			{
+				std::vector<unsigned char> &packet = packets[u];
+				unsigned char *data = &packet[headerSize];
+				packet[sequenceOffset] = sequence;
+				data[0] = number >> 8;
+				data[1] = number & 0xFF;
+				for(int i = 0; i < changes; i++)
+				{
+					data[3 + Random(&random) % (options.channels - 3)] = Random(&random);
+				}
+				int64_t now = GetMonotonicTime();
+				if(sendto(sock, &packet[0], packet.size(), 0, (sockaddr *)&addresses[u], sizeof(addresses[u])) < 0)
+				{
+					fprintf(stderr, "Could not send packet: %s\n", strerror(errno));
+					continue;
+				}
+				state.sent++;
+				state.sendTimes[u][number] = now;
+			}
+			if(options.sync &&
+				sendto(sock, &syncPacket[0], syncPacket.size(), 0, (sockaddr *)&syncAddress, sizeof(syncAddress)) < 0)
+			{
+				fprintf(stderr, "Could not send sync packet: %s\n", strerror(errno));
+			}
+		}
+	}
+	int64_t sendTime = GetMonotonicTime() - start;
+	
+	// Wait for the last frames
+	int64_t end = GetMonotonicTime() + BENCH_DRAINTIME;
+	int64_t now;
+	while((now = GetMonotonicTime()) < end)
+	{
+		struct pollfd fd = {traceSock, POLLIN, 0};
+		if(poll(&fd, 1, (end - now) / 1000000 + 1) > 0)
+			ReceiveTraces(traceSock, &state);
+	}
+	benchCpu = GetProcessCpuTime() - benchCpu;
+	daemonTicks = GetProcessCpuTicks("dmxd") - daemonTicks;
+	int64_t wallTime = GetMonotonicTime() - start;
+	
+	close(sock);
+	close(traceSock);
+	unlink(options.trace);
+	
+	std::vector<int64_t> &latencies = state.latencies;
+	std::sort(latencies.begin(), latencies.end());
+	printf("frames sent:      %llu packets in %.2f s (%.0f packets/s)\n", (unsigned long long)state.sent,
+		sendTime / 1e9, state.sent * 1e9 / sendTime);
+	printf("frames output:    %llu of %llu frames (%.0f frames/s)\n",
+		(unsigned long long)state.received, (unsigned long long)state.sent, state.received * 1e9 / sendTime);
+	printf("frames dropped:   %llu\n", (unsigned long long)(state.sent - state.received));
+	printf("interface writes: %llu\n", (unsigned long long)state.traced);
+	if(latencies.empty())
+	{
+		printf("latency:          no frames received, is the daemon running with the simulator\n"
+			"                  and SimulatorTrace = %s?\n", options.trace);
+	} else {
+		printf("latency:          p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n",
+			Percentile(latencies, 50) / 1e6, Percentile(latencies, 99) / 1e6,
+			Percentile(latencies, 99.9) / 1e6, latencies.back() / 1e6);
+	}
+	printf("cpu dmxd:         %.1f%%\n", daemonTicks * 100.0 / ticksPerSecond / (wallTime / 1e9));
+	printf("cpu dmxd-bench:   %.1f%%\n", benchCpu * 100.0 / wallTime);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	BenchOptions options;
+	options.ip = "127.0.0.1";
+	options.trace = "/tmp/dmxd-trace";
+	options.universes = 1;
+	options.firstUniverse = 0;
+	options.rate = 44;
+	options.duration = 10;
+	options.channels = ARTNETMAXCHANNELS;
+	options.density = 0.1;
+	options.burst = 1;
+	options.sync = false;
+	options.sacn = false;
+	
+	int c;
+	while((c = getopt(argc, argv, "a:t:u:U:r:d:c:x:B:Ssh")) != -1)
+	{
+		switch(c)
+		{
+		case 'a':
+			options.ip = optarg;
+			break;
+		case 't':
+			options.trace = optarg;
+			break;
+		case 'u':
+			options.universes = std::min(256, std::max(1, atoi(optarg)));
+			break;
+		case 'U':
+			options.firstUniverse = atoi(optarg) & 0x7FFF;
+			break;
+		case 'r':
+			options.rate = std::max(0.1, atof(optarg));
+			break;
+		case 'd':
+			options.duration = std::max(0.1, atof(optarg));
+			break;
+		case 'c':
+			options.channels = atoi(optarg);
+			if(options.channels < 4 || options.channels > ARTNETMAXCHANNELS)
+				options.channels = ARTNETMAXCHANNELS;
+			break;
+		case 'x':
+			options.density = std::min(1.0, std::max(0.0, atof(optarg)));
+			break;
+		case 'B':
+			options.burst = std::max(1, atoi(optarg));
+			break;
+		case 'S':
+			options.sync = true;
+			break;
+		case 's':
+			options.sacn = true;
+			break;
+		default:
+			printf("Usage %s [-a ip][-t trace][-u universes][-U first][-r rate][-d duration]\n"
+				"\t[-c channels][-x density][-B burst][-S][-s]\n\n"
+				"\t-a ip: Ip address of the daemon\n"
+				"\t-t trace: Unix socket that receives the traces of the simulator, the\n"
+				"\t\tSimulatorTrace setting of the daemon\n"
+				"\t-u universes: Number of universes to send\n"
+				"\t-U first: Port-address of the first universe\n"
+				"\t-r rate: Frames per second per universe\n"
+				"\t-d duration: Duration in seconds\n"
+				"\t-c channels: Number of channels in every frame\n"
+				"\t-x density: Fraction of the channels that changes every frame\n"
+				"\t-B burst: Number of frames that are sent back to back, the average\n"
+				"\t\trate stays the same\n"
+				"\t-S: Send a synchronization packet after the frames of all universes\n"
+				"\t-s: Send sACN to the multicast groups of universe port-address + 1\n"
+				"\t\tinstead of Art-Net, the daemon needs SacnUniverses = auto\n", argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	
+	return RunBenchmark(options) ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+#include <cassert>
+#include "logger.h"
+#include "timehelper.h"
+#include "eventloop.h"
+
+EventLoop::EventLoop()
+{
+	mStopped = false;
+	mIterationsMetric = METRIC_NONE;
+	mTimeMetric = METRIC_NONE;
+	mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	if(mEpollFd < 0)
+	{
+		Error("Could not create event loop: %s", strerror(errno));
+	}
+}
+
+EventLoop::~EventLoop()
+{
+	for(std::map<int, Watch *>::iterator it = mWatches.begin(); it != mWatches.end(); ++it)
+	{
+		if(it->second->timer)
+			close(it->first);
+		delete it->second;
+	}
+	for(size_t i = 0; i < mRemoved.size(); i++)
+	{
+		delete mRemoved[i];
+	}
+	if(mEpollFd >= 0)
+		close(mEpollFd);
+}
+
+bool EventLoop::IsValid() const
+{
+	return mEpollFd >= 0;
+}
+
+bool EventLoop::AddWatch(Watch *watch, uint32_t events)
+{
+	assert(IsValid());
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = events;
+	event.data.ptr = watch;
+	if(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, watch->fd, &event) < 0)
+	{
+		Error("Could not watch file descriptor %d: %s", watch->fd, strerror(errno));
+		delete watch;
+		return false;
+	}
+	mWatches[watch->fd] = watch;
+	return true;
+}
+
+void EventLoop::RemoveWatch(int fd)
+{
+	std::map<int, Watch *>::iterator it = mWatches.find(fd);
+	if(it == mWatches.end())
+		return;
+	epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
+	// The watch can still be referenced by events that are not dispatched yet
+	it->second->fd = -1;
+	mRemoved.push_back(it->second);
+	mWatches.erase(it);
+}
+
+bool EventLoop::AddFd(int fd, uint32_t events, EventCallback_t callback, void *data)
+{
+	assert(callback != NULL);
+	Watch *watch = new Watch;
+	watch->fd = fd;
+	watch->timer = false;
+	watch->callback = callback;
+	watch->timerCallback = NULL;
+	watch->data = data;
+	return AddWatch(watch, events);
+}
+
+bool EventLoop::ModifyFd(int fd, uint32_t events)
+{
+	std::map<int, Watch *>::iterator it = mWatches.find(fd);
+	if(it == mWatches.end())
+		return false;
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = events;
+	event.data.ptr = it->second;
+	if(epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &event) < 0)
+	{
+		Error("Could not modify watch on file descriptor %d: %s", fd, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+void EventLoop::RemoveFd(int fd)
+{
+	RemoveWatch(fd);
+}
+
+int EventLoop::AddTimer(int intervalMs, TimerCallback_t callback, void *data)
+{
+	assert(intervalMs > 0);
+	struct itimerspec spec;
+	spec.it_interval.tv_sec = intervalMs / 1000;
+	spec.it_interval.tv_nsec = (intervalMs % 1000) * 1000000L;
+	spec.it_value = spec.it_interval;
+	return CreateTimer(spec, callback, data);
+}
+
+int EventLoop::AddOneShotTimer(TimerCallback_t callback, void *data)
+{
+	// A zero value creates the timer disarmed
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	return CreateTimer(spec, callback, data);
+}
+
+bool EventLoop::SetTimerDeadline(int timer, uint64_t deadline)
+{
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	if(deadline != 0)
+		spec.it_value = NsToTimespec(deadline);
+	if(timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+	{
+		Error("Could not set timer: %s", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+int EventLoop::CreateTimer(const struct itimerspec &spec, TimerCallback_t callback, void *data)
+{
+	assert(callback != NULL);
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(fd < 0)
+	{
+		Error("Could not create timer: %s", strerror(errno));
+		return -1;
+	}
+	if(timerfd_settime(fd, 0, &spec, NULL) < 0)
+	{
+		Error("Could not start timer: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	
+	Watch *watch = new Watch;
+	watch->fd = fd;
+	watch->timer = true;
+	watch->callback = NULL;
+	watch->timerCallback = callback;
+	watch->data = data;
+	if(!AddWatch(watch, EPOLLIN))
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void EventLoop::RemoveTimer(int timer)
+{
+	if(mWatches.find(timer) == mWatches.end())
+		return;
+	RemoveWatch(timer);
+	close(timer);
+}
+
+void EventLoop::Run(int *running)
+{
+	assert(IsValid());
+	assert(running != NULL);
+	
+	// Block the signals that stop the loop, they are unblocked atomically
+	// while waiting in epoll_pwait
+	sigset_t blocked;
+	sigset_t original;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGTERM);
+	sigaddset(&blocked, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &blocked, &original);
+	
+	mStopped = false;
+	while(*running && !mStopped)
+	{
+		struct epoll_event events[EVENTLOOP_MAXEVENTS];
+		int count = epoll_pwait(mEpollFd, events, EVENTLOOP_MAXEVENTS, -1, &original);
+		if(count < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			Error("Could not wait for events: %s", strerror(errno));
+			break;
+		}
+		uint64_t start = 0;
+		if(mTimeMetric != METRIC_NONE)
+			start = GetMonotonicTime();
+		for(int i = 0; i < count; i++)
+		{
+			Watch *watch = (Watch *)events[i].data.ptr;
+			// Removed by an earlier callback
+			if(watch->fd < 0)
+				continue;
+			if(watch->timer)
+			{
+				uint64_t expirations;
+				if(read(watch->fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+				{
+					watch->timerCallback(expirations, watch->data);
+				}
+			} else {
+				watch->callback(watch->fd, events[i].events, watch->data);
+			}
+		}
+		for(size_t i = 0; i < mRemoved.size(); i++)
+		{
+			delete mRemoved[i];
+		}
+		mRemoved.clear();
+		if(mIterationsMetric != METRIC_NONE)
+			Metrics::Add(mIterationsMetric);
+		if(mTimeMetric != METRIC_NONE)
+			Metrics::Add(mTimeMetric, GetMonotonicTime() - start);
+	}
+	
+	sigprocmask(SIG_SETMASK, &original, NULL);
+}
+
+void EventLoop::Stop()
+{
+	mStopped = true;
+}
+
+void EventLoop::SetMetrics(Metric_t iterations, Metric_t time)
+{
+	mIterationsMetric = iterations;
+	mTimeMetric = time;
+}
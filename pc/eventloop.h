@@ -0,0 +1,105 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _EVENTLOOP_H_
+#define _EVENTLOOP_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <map>
+#include <vector>
+#include "metrics.h"
+
+#define EVENTLOOP_MAXEVENTS 16
+
+// Callback that is called when a watched file descriptor is ready
+// events contains the epoll events that occured
+typedef void (*EventCallback_t)(int fd, uint32_t events, void *data);
+// Callback that is called when a timer expires
+// expirations contains the number of expirations since the last call
+typedef void (*TimerCallback_t)(uint64_t expirations, void *data);
+
+// Epoll based event loop
+// The loop blocks until one of the watched file descriptors becomes ready or
+// one of the timers expires, so an idle process does not wake up.
+class EventLoop
+{
+public:
+	EventLoop();
+	~EventLoop();
+	
+	bool IsValid() const;
+	
+	// Watch fd for the given epoll events (EPOLLIN, EPOLLOUT)
+	// Returns true when successful
+	bool AddFd(int fd, uint32_t events, EventCallback_t callback, void *data);
+	// Change the events that are watched for fd
+	bool ModifyFd(int fd, uint32_t events);
+	// Stop watching fd
+	void RemoveFd(int fd);
+	
+	// Create a periodic timer with an interval in milliseconds
+	// Returns the timer id or -1 when the timer could not be created
+	int AddTimer(int intervalMs, TimerCallback_t callback, void *data);
+	// Create a one-shot timer that is armed with SetTimerDeadline
+	// Returns the timer id or -1 when the timer could not be created
+	int AddOneShotTimer(TimerCallback_t callback, void *data);
+	// Let a one-shot timer expire at deadline on the monotonic clock in ns
+	// A deadline of 0 disarms the timer
+	bool SetTimerDeadline(int timer, uint64_t deadline);
+	// Remove a timer created with AddTimer or AddOneShotTimer
+	void RemoveTimer(int timer);
+	
+	// Dispatch events until *running becomes 0 or Stop() is called
+	// SIGTERM and SIGCHLD are only delivered while the loop is waiting, so a
+	// signal handler clearing *running always ends the loop
+	void Run(int *running);
+	// Make Run return after the current events are handled
+	void Stop();
+	
+	// Count the loop iterations and the time spent in the callbacks in the
+	// given metrics
+	void SetMetrics(Metric_t iterations, Metric_t time);
+	
+private:
+	struct Watch {
+		int fd;
+		bool timer;
+		EventCallback_t callback;
+		TimerCallback_t timerCallback;
+		void *data;
+	};
+	
+	bool AddWatch(Watch *watch, uint32_t events);
+	// Create a timerfd that is started with spec and watch it
+	int CreateTimer(const struct itimerspec &spec, TimerCallback_t callback, void *data);
+	void RemoveWatch(int fd);
+	
+	int mEpollFd;
+	bool mStopped;
+	std::map<int, Watch *> mWatches;
+	// Watches removed while dispatching, deleted after the dispatch
+	std::vector<Watch *> mRemoved;
+	Metric_t mIterationsMetric;
+	Metric_t mTimeMetric;
+};
+
+#endif
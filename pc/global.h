@@ -31,6 +31,30 @@ THE SOFTWARE.*/
 #define DEFAULT_ARTNETLONGNAME "SPI-DMX Art-Net daemon http://www.robojan.nl"
 #define DEFAULT_ARTNETSHORTNAME "SPI-DMX daemon"
 #define DEFAULT_INITIALSTATE "off"
+#define DEFAULT_STATISTICSINTERVAL 60
+#define DEFAULT_ARTNETENGINE "native"
+#define DEFAULT_ARTNETNET 0
+#define DEFAULT_ARTNETSUBNET 0
+#define DEFAULT_ARTNETUNIVERSE 0
+#define DEFAULT_IPCTRANSPORT "pipe"
+#define DEFAULT_IPCQUEUESIZE 65536
+#define DEFAULT_IPCDROPPOLICY "stale"
+#define DEFAULT_SPIBACKEND "spidev"
+#define DEFAULT_SPITRANSFERDELAY 20
+#define DEFAULT_SPICSCHANGE "on"
+#define DEFAULT_SIMULATORTRACE "off"
+#define DEFAULT_OUTPUTS "single"
+#define DEFAULT_ARTNETSYNCTIMEOUT 4000
+#define DEFAULT_SACNUNIVERSES "off"
+#define DEFAULT_SACNIP "0.0.0.0"
+#define DEFAULT_MERGEMODE "htp"
+#define DEFAULT_MERGETIMEOUT 2500
+#define DEFAULT_OUTPUTRATE 0
+#define DEFAULT_METRICSENDPOINT "off"
+#define DEFAULT_OUTPUTPRIORITY 0
+#define DEFAULT_OUTPUTCPU -1
+#define DEFAULT_LOCKMEMORY "off"
+#define DEFAULT_WAKEUPTEST 0
 
 #define WORKING_DIRECTORY "/"
 
@@ -24,25 +24,19 @@ THE SOFTWARE.*/
 #include <cerrno>
 #include <cstring>
 #include <cassert>
+#include <cstdlib>
 #include <sstream>
+#include <algorithm>
 #include <fcntl.h>
+#include <sys/uio.h>
 #include "logger.h"
 #include "ipc.h"
 #include "datahelper.h"
-
-IPCMessage::IPCMessage(const unsigned char *data)
-{
-	mType = DataHelper::GetInt32(data);
-	mSize = DataHelper::GetInt32(data+4);
-	if(mSize == 0)
-	{
-		mData = NULL;
-	} else {
-		mData = malloc(mSize);
-		memcpy(mData, data+8, mSize);
-	}
-}
-
+#include "messages.h"
+#include "eventloop.h"
+#include "stringhelper.h"
+#include "metrics.h"
+#include <sys/epoll.h>
 
 // Empty constructor
 IPCMessage::IPCMessage()
@@ -50,6 +44,7 @@ IPCMessage::IPCMessage()
 	mType = -1;
 	mSize = 0;
 	mData = NULL;
+	mOwned = false;
 }
 
 // Constructor for setting the data
@@ -57,20 +52,52 @@ IPCMessage::IPCMessage(int type, int size, const void *data)
 {
 	mType = type;
 	mSize = size;
+	mOwned = true;
 	if(mSize == 0)
 	{
 		mData = NULL;
 	} else {
-		mData = malloc(mSize);
+		mData = mSize <= IPCMESSAGE_INLINESIZE ? mInline : malloc(mSize);
 		memcpy(mData, data, mSize);
 	}
 }
 
+// Constructor that reserves size bytes of data
+IPCMessage::IPCMessage(int type, int size)
+{
+	mType = type;
+	mSize = size;
+	mOwned = true;
+	if(mSize == 0)
+	{
+		mData = NULL;
+	} else {
+		mData = mSize <= IPCMESSAGE_INLINESIZE ? mInline : malloc(mSize);
+	}
+}
+
 // Destructor for IPCMessage
 IPCMessage::~IPCMessage()
 {
-	if(mData != NULL)
+	Release();
+}
+
+// Free the data when it is owned
+void IPCMessage::Release()
+{
+	if(mOwned && mData != NULL && mData != mInline)
 		free(mData);
+	mData = NULL;
+	mOwned = false;
+}
+
+// Make the message refer to data that is owned by somebody else
+void IPCMessage::SetView(int type, int size, const void *data)
+{
+	Release();
+	mType = type;
+	mSize = size;
+	mData = (void *)data;
 }
 
 // Function that returns the type of the message
@@ -91,6 +118,13 @@ int IPCMessage::GetDataSize() const
 	return mSize;
 }
 
+// Get the data for writing
+void *IPCMessage::GetBuffer()
+{
+	assert(mOwned);
+	return mData;
+}
+
 // Function that returns an human readable representation of the mesage
 std::string IPCMessage::ToString() const
 {
@@ -104,7 +138,36 @@ IPC::IPC(int readfd, int writefd)
 {
 	mReadFd = readfd;
 	mWriteFd = writefd;
-	mReadingBufferSize = 0;
+	mSentMessages = 0;
+	mCoalescedMessages = 0;
+	mShared = NULL;
+	mReadCapacity = IPC_RECEIVINGBUFFERSIZE;
+	mReadBuffer = (unsigned char *)malloc(mReadCapacity);
+	mReadStart = 0;
+	mReadEnd = 0;
+	mParsePos = 0;
+	mEntries.resize(IPC_QUEUESIZE);
+	mEntryHead = 0;
+	mEntryCount = 0;
+	mAvailableMessages = 0;
+	mWriteCapacity = IPC_RECEIVINGBUFFERSIZE;
+	mWriteBuffer = (unsigned char *)malloc(mWriteCapacity);
+	mWriteEnd = 0;
+	mOutFrames.resize(IPC_QUEUESIZE);
+	mOutHead = 0;
+	mOutCount = 0;
+	mOutWritten = 0;
+	mPendingBytes = 0;
+	mQueueLimit = IPC_OUTQUEUESIZE;
+	mDropPolicy = IPC_DROP_STALE;
+	mQueuedBytes = 0;
+	mDroppedFrames = 0;
+	mQueueHighWater = 0;
+	mQueueMetric = METRIC_NONE;
+	mReportedQueuedBytes = 0;
+	mReportedDroppedFrames = 0;
+	mLoop = NULL;
+	mWatchingWritable = false;
 	fcntl(mReadFd, F_SETFL, O_NONBLOCK);
 	fcntl(mWriteFd, F_SETFL, O_NONBLOCK);
 }
@@ -112,83 +175,618 @@ IPC::IPC(int readfd, int writefd)
 // Destructor
 IPC::~IPC()
 {
-	
+	WatchWritable(false);
+	free(mReadBuffer);
+	free(mWriteBuffer);
 }
 
+// Make room at the end of the receive buffer for at least size bytes
+void IPC::ReserveReadBuffer(size_t size)
+{
+	if(mReadCapacity - mReadEnd >= size)
+		return;
+	
+	// Move the data that is still used to the front of the buffer
+	if(mReadStart > 0)
+	{
+		memmove(mReadBuffer, mReadBuffer + mReadStart, mReadEnd - mReadStart);
+		for(size_t i = 0; i < mEntryCount; i++)
+		{
+			mEntries[(mEntryHead + i) % mEntries.size()].offset -= mReadStart;
+		}
+		mParsePos -= mReadStart;
+		mReadEnd -= mReadStart;
+		mReadStart = 0;
+	}
+	
+	// Grow the buffer when it is still too small
+	if(mReadCapacity - mReadEnd < size)
+	{
+		size_t capacity = mReadCapacity;
+		while(capacity - mReadEnd < size)
+		{
+			capacity *= 2;
+		}
+		mReadBuffer = (unsigned char *)realloc(mReadBuffer, capacity);
+		mReadCapacity = capacity;
+	}
+}
 
 // This function reads data from the pipe and tries to create an message from it
 // This function needs to be called periodically to prevent buffer overflows
 void IPC::Tick()
 {
-	ssize_t len;
+	if(mLoop == NULL && mOutCount > 0)
+	{
+		Flush();
+	}
+	
+	// The data of the messages that are already handled can be reused
+	if(mEntryCount == 0)
+	{
+		mReadStart = mParsePos;
+		if(mReadStart == mReadEnd)
+		{
+			mReadStart = 0;
+			mReadEnd = 0;
+			mParsePos = 0;
+		}
+	} else {
+		mReadStart = mEntries[mEntryHead].offset - 8;
+	}
+	
 	// Read all available data into buffer
-	do {
-		len = read(mReadFd, mReadingBuffer+mReadingBufferSize, IPC_RECEIVINGBUFFERSIZE - mReadingBufferSize);
+	for(;;)
+	{
+		if(mReadEnd == mReadCapacity)
+		{
+			ReserveReadBuffer(IPC_RECEIVINGBUFFERSIZE / 2);
+		}
+		ssize_t len = read(mReadFd, mReadBuffer + mReadEnd, mReadCapacity - mReadEnd);
 		if(len < 0)
 		{
+			if(errno == EINTR)
+				continue;
 			if(errno != EAGAIN)
 			{
 				Error("Could not read IPC channel: %s", strerror(errno));
 			}
 			break;
 		}
-		mReadingBufferSize+=len;
-	} while(len > 0);
-	// Try to read messages
-	while(mReadingBufferSize >= 8)
+		if(len == 0)
+			break;
+		mReadEnd += len;
+		ParseMessages();
+	}
+}
+
+// Decode the complete messages in the receive buffer
+void IPC::ParseMessages()
+{
+	while(mReadEnd - mParsePos >= 8)
 	{
-		int type = DataHelper::GetInt32(mReadingBuffer);
-		int size = DataHelper::GetInt32(mReadingBuffer+4);
-		if(mReadingBufferSize < 8+size)
+		int type = DataHelper::GetInt32(mReadBuffer + mParsePos);
+		int size = DataHelper::GetInt32(mReadBuffer + mParsePos + 4);
+		if(size < 0 || size > IPC_MAXMESSAGESIZE)
+		{
+			// The stream can't be trusted anymore, drop everything
+			Error("Invalid IPC message of %d bytes received", size);
+			mReadStart = mReadEnd = mParsePos = 0;
+			mEntryHead = mEntryCount = 0;
+			mAvailableMessages = 0;
+			return;
+		}
+		if(mReadEnd - mParsePos < (size_t)size + 8)
 		{
-			// Buffer not large enoug
+			// Make sure that the rest of a large message fits in the buffer
+			ReserveReadBuffer(size + 8 - (mReadEnd - mParsePos));
 			break;
 		}
-		IPCMessage *message = new IPCMessage(mReadingBuffer);
-		mMessageQueue.push(message);
-		memmove(mReadingBuffer, mReadingBuffer+size+8, mReadingBufferSize - size - 8);
-		mReadingBufferSize -= size + 8;
+		PushEntry(type, size, mParsePos + 8);
+		mParsePos += size + 8;
 	}
 }
 
-// Send an message to the other side
-void IPC::SendMessage(const IPCMessage &message)
+// Add a decoded message to the queue
+void IPC::PushEntry(int type, int size, size_t offset)
+{
+	if(mEntryCount == mEntries.size())
+	{
+		// Grow the queue and make the entries contiguous again
+		std::vector<Entry> entries(mEntries.size() * 2);
+		for(size_t i = 0; i < mEntryCount; i++)
+		{
+			entries[i] = mEntries[(mEntryHead + i) % mEntries.size()];
+		}
+		mEntries.swap(entries);
+		mEntryHead = 0;
+	}
+	Entry &entry = mEntries[(mEntryHead + mEntryCount) % mEntries.size()];
+	entry.type = type;
+	entry.size = size;
+	entry.offset = offset;
+	entry.removed = false;
+	if(type == MSG_SETCHANNELS)
+	{
+		Coalesce(entry);
+	}
+	mEntryCount++;
+	mAvailableMessages++;
+}
+
+// Remove the queued channel messages that are superseded by the entry
+// Only the newest state of the channels has to be written to the hardware
+void IPC::Coalesce(const Entry &entry)
+{
+	if(entry.size < SETCHANNELS_HEADERSIZE)
+		return;
+	int output = DataHelper::GetInt32(mReadBuffer + entry.offset);
+	int address = DataHelper::GetInt32(mReadBuffer + entry.offset + 4);
+	int count = entry.size - SETCHANNELS_HEADERSIZE;
+	
+	for(size_t i = 0; i < mEntryCount; i++)
+	{
+		Entry &queued = mEntries[(mEntryHead + i) % mEntries.size()];
+		if(queued.removed || queued.type != MSG_SETCHANNELS || queued.size < SETCHANNELS_HEADERSIZE)
+			continue;
+		int queuedOutput = DataHelper::GetInt32(mReadBuffer + queued.offset);
+		int queuedAddress = DataHelper::GetInt32(mReadBuffer + queued.offset + 4);
+		int queuedCount = queued.size - SETCHANNELS_HEADERSIZE;
+		if(queuedOutput == output && queuedAddress >= address &&
+			queuedAddress + queuedCount <= address + count)
+		{
+			queued.removed = true;
+			mAvailableMessages--;
+			mCoalescedMessages++;
+			Metrics::Add(METRIC_FRAMES_COALESCED);
+		}
+	}
+}
+
+// Convert the name of a drop policy to the policy
+IPCDropPolicy_t ParseDropPolicy(const std::string &name)
+{
+	std::string policy = ToLower(name);
+	if(policy == "oldest")
+		return IPC_DROP_OLDEST;
+	if(policy == "newest")
+		return IPC_DROP_NEWEST;
+	if(policy != "stale")
+		Warn("Unknown IPC drop policy \"%s\", using stale", name.c_str());
+	return IPC_DROP_STALE;
+}
+
+// Write a message consisting of count parts to the pipe
+// Messages are only written directly when nothing is queued, otherwise they
+// would overtake the queued messages
+void IPC::WriteVector(int type, struct iovec *iov, int count)
 {
-	unsigned char *buffer = new unsigned char[message.GetDataSize() + 8];
-	DataHelper::SetInt32(buffer, message.GetType());
-	DataHelper::SetInt32(buffer+4, message.GetDataSize());
-	memcpy(buffer+8, message.GetData(), message.GetDataSize());
 	size_t written = 0;
-	while(written < message.GetDataSize() + 8)
+	if(mOutCount == 0)
 	{
-		ssize_t result = write(mWriteFd, buffer+written, message.GetDataSize() + 8 - written);
+		size_t size = 0;
+		for(int i = 0; i < count; i++)
+		{
+			size += iov[i].iov_len;
+		}
+		for(;;)
+		{
+			ssize_t result = writev(mWriteFd, iov, count);
+			if(result < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				if(errno != EAGAIN)
+				{
+					Error("Could not write IPC channel: %s", strerror(errno));
+					return;
+				}
+				break;
+			}
+			written = result;
+			break;
+		}
+		if(written == size)
+		{
+			mSentMessages++;
+			return;
+		}
+	}
+	QueueFrame(type, iov, count, written);
+}
+
+// Add a message to the outbound queue
+void IPC::QueueFrame(int type, const struct iovec *iov, int count, size_t written)
+{
+	OutFrame frame;
+	frame.type = type;
+	frame.size = 0;
+	for(int i = 0; i < count; i++)
+	{
+		frame.size += iov[i].iov_len;
+	}
+	frame.output = 0;
+	frame.address = 0;
+	frame.count = 0;
+	frame.dropped = false;
+	if(type == MSG_SETCHANNELS && frame.size >= 8 + SETCHANNELS_HEADERSIZE)
+	{
+		// The output and address directly follow the header
+		unsigned char header[16];
+		size_t copied = 0;
+		for(int i = 0; i < count && copied < sizeof(header); i++)
+		{
+			size_t part = std::min(iov[i].iov_len, sizeof(header) - copied);
+			memcpy(header + copied, iov[i].iov_base, part);
+			copied += part;
+		}
+		frame.output = DataHelper::GetInt32(header + 8);
+		frame.address = DataHelper::GetInt32(header + 12);
+		frame.count = frame.size - 8 - SETCHANNELS_HEADERSIZE;
+	}
+	
+	// A partially written frame is always queued, otherwise the stream breaks
+	if(written == 0 && !MakeRoom(frame))
+	{
+		mDroppedFrames++;
+		Metrics::Add(METRIC_FRAMES_DROPPED);
+		return;
+	}
+	
+	ReserveWriteBuffer(frame.size);
+	frame.offset = mWriteEnd;
+	for(int i = 0; i < count; i++)
+	{
+		memcpy(mWriteBuffer + mWriteEnd, iov[i].iov_base, iov[i].iov_len);
+		mWriteEnd += iov[i].iov_len;
+	}
+	
+	if(mOutCount == mOutFrames.size())
+	{
+		// Grow the queue and make the frames contiguous again
+		std::vector<OutFrame> frames(mOutFrames.size() * 2);
+		for(size_t i = 0; i < mOutCount; i++)
+		{
+			frames[i] = mOutFrames[(mOutHead + i) % mOutFrames.size()];
+		}
+		mOutFrames.swap(frames);
+		mOutHead = 0;
+	}
+	mOutFrames[(mOutHead + mOutCount) % mOutFrames.size()] = frame;
+	mOutCount++;
+	if(mOutCount == 1)
+	{
+		mOutWritten = written;
+	}
+	mPendingBytes += frame.size - written;
+	mQueuedBytes += frame.size - written;
+	if(mPendingBytes > mQueueHighWater)
+	{
+		mQueueHighWater = mPendingBytes;
+	}
+	if(mQueueMetric != METRIC_NONE)
+		Metrics::Set(mQueueMetric, mPendingBytes);
+	WatchWritable(true);
+}
+
+// Make room for a frame according to the drop policy
+bool IPC::MakeRoom(const OutFrame &frame)
+{
+	if(frame.type != MSG_SETCHANNELS)
+		return true;
+	
+	// Frames that will be overwritten by this frame are useless
+	if(mDropPolicy == IPC_DROP_STALE)
+	{
+		for(size_t i = 0; i < mOutCount; i++)
+		{
+			OutFrame &queued = mOutFrames[(mOutHead + i) % mOutFrames.size()];
+			if((i > 0 || mOutWritten == 0) && !queued.dropped && 
+				queued.type == MSG_SETCHANNELS && queued.size >= 8 + SETCHANNELS_HEADERSIZE &&
+				queued.output == frame.output && queued.address >= frame.address &&
+				queued.address + queued.count <= frame.address + frame.count)
+			{
+				DropFrame(queued);
+			}
+		}
+	}
+	
+	if(mPendingBytes + frame.size <= mQueueLimit)
+		return true;
+	if(mDropPolicy == IPC_DROP_NEWEST)
+		return false;
+	
+	// Drop the oldest channel frames that are not being written yet
+	for(size_t i = 0; i < mOutCount && mPendingBytes + frame.size > mQueueLimit; i++)
+	{
+		OutFrame &queued = mOutFrames[(mOutHead + i) % mOutFrames.size()];
+		if((i > 0 || mOutWritten == 0) && !queued.dropped && queued.type == MSG_SETCHANNELS)
+		{
+			DropFrame(queued);
+		}
+	}
+	return true;
+}
+
+// Drop a frame that is not written yet
+void IPC::DropFrame(OutFrame &frame)
+{
+	frame.dropped = true;
+	mPendingBytes -= frame.size;
+	mDroppedFrames++;
+	Metrics::Add(METRIC_FRAMES_DROPPED);
+}
+
+// Make room at the end of the outbound buffer for at least size bytes
+void IPC::ReserveWriteBuffer(size_t size)
+{
+	if(mWriteCapacity - mWriteEnd >= size)
+		return;
+	
+	// Move the queued frames to the front of the buffer
+	size_t start = mOutCount > 0 ? mOutFrames[mOutHead].offset : mWriteEnd;
+	if(start > 0)
+	{
+		memmove(mWriteBuffer, mWriteBuffer + start, mWriteEnd - start);
+		for(size_t i = 0; i < mOutCount; i++)
+		{
+			mOutFrames[(mOutHead + i) % mOutFrames.size()].offset -= start;
+		}
+		mWriteEnd -= start;
+	}
+	
+	if(mWriteCapacity - mWriteEnd < size)
+	{
+		size_t capacity = mWriteCapacity;
+		while(capacity - mWriteEnd < size)
+		{
+			capacity *= 2;
+		}
+		mWriteBuffer = (unsigned char *)realloc(mWriteBuffer, capacity);
+		mWriteCapacity = capacity;
+	}
+}
+
+// Write as much of the outbound queue as possible
+void IPC::Flush()
+{
+	while(mOutCount > 0)
+	{
+		// Remove the frames that are dropped or completely written
+		OutFrame &head = mOutFrames[mOutHead];
+		if(head.dropped || mOutWritten == head.size)
+		{
+			if(!head.dropped)
+				mSentMessages++;
+			mOutHead = (mOutHead + 1) % mOutFrames.size();
+			mOutCount--;
+			mOutWritten = 0;
+			continue;
+		}
+		
+		struct iovec iov[IPC_MAXWRITEFRAMES];
+		int count = 0;
+		for(size_t i = 0; i < mOutCount && count < IPC_MAXWRITEFRAMES; i++)
+		{
+			OutFrame &frame = mOutFrames[(mOutHead + i) % mOutFrames.size()];
+			if(frame.dropped)
+				continue;
+			size_t skip = i == 0 ? mOutWritten : 0;
+			iov[count].iov_base = mWriteBuffer + frame.offset + skip;
+			iov[count].iov_len = frame.size - skip;
+			count++;
+		}
+		
+		ssize_t result = writev(mWriteFd, iov, count);
 		if(result < 0)
 		{
+			if(errno == EINTR)
+				continue;
 			if(errno != EAGAIN)
 			{
 				Error("Could not write IPC channel: %s", strerror(errno));
+				mOutCount = 0;
+				mPendingBytes = 0;
 			}
 			break;
 		}
-		written+=result;
+		mPendingBytes -= result;
+		
+		// Advance over the written frames
+		size_t left = result;
+		while(left > 0)
+		{
+			OutFrame &frame = mOutFrames[mOutHead];
+			if(frame.dropped)
+			{
+				mOutHead = (mOutHead + 1) % mOutFrames.size();
+				mOutCount--;
+				continue;
+			}
+			size_t part = std::min(left, frame.size - mOutWritten);
+			mOutWritten += part;
+			left -= part;
+			if(mOutWritten == frame.size)
+			{
+				mSentMessages++;
+				mOutHead = (mOutHead + 1) % mOutFrames.size();
+				mOutCount--;
+				mOutWritten = 0;
+			}
+		}
 	}
-	delete[] buffer;
+	
+	if(mOutCount == 0)
+	{
+		mOutHead = 0;
+		mWriteEnd = 0;
+		WatchWritable(false);
+	}
+	if(mQueueMetric != METRIC_NONE)
+		Metrics::Set(mQueueMetric, mPendingBytes);
 }
 
-// This function returns an message in message which is received from the pipe
-// Returns true when successful
-IPCMessage *IPC::GetMessage()
+// Start or stop waiting for the pipe to become writable
+void IPC::WatchWritable(bool watch)
 {
-	IPCMessage *message;
-	if(mMessageQueue.size() == 0)
-		return NULL;
-	message = mMessageQueue.front();
-	mMessageQueue.pop();
-	return message;
+	if(mLoop == NULL || watch == mWatchingWritable)
+		return;
+	if(watch)
+	{
+		mWatchingWritable = mLoop->AddFd(mWriteFd, EPOLLOUT, HandleWritable, this);
+	} else {
+		mLoop->RemoveFd(mWriteFd);
+		mWatchingWritable = false;
+	}
+}
+
+// Called by the event loop when the pipe is writable
+void IPC::HandleWritable(int fd, uint32_t events, void *data)
+{
+	IPC *ipc = (IPC *)data;
+	ipc->Flush();
+}
+
+// Send an message to the other side
+void IPC::SendMessage(const IPCMessage &message)
+{
+	SendMessage(message.GetType(), message.GetDataSize(), message.GetData());
+}
+
+// Send an message to the other side without creating an IPCMessage
+void IPC::SendMessage(int type, int size, const void *data)
+{
+	unsigned char header[8];
+	DataHelper::SetInt32(header, type);
+	DataHelper::SetInt32(header+4, size);
+	struct iovec iov[2];
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = (void *)data;
+	iov[1].iov_len = size;
+	WriteVector(type, iov, size > 0 ? 2 : 1);
+}
+
+// Send channel values to the other side
+void IPC::SendChannels(int output, int address, int count, const uint8_t *values, uint64_t stamp)
+{
+	if(mShared != NULL)
+	{
+		mShared->Write(output, address, count, values, stamp);
+		mSentMessages++;
+		return;
+	}
+	unsigned char header[8 + SETCHANNELS_HEADERSIZE];
+	DataHelper::SetInt32(header, MSG_SETCHANNELS);
+	DataHelper::SetInt32(header+4, count + SETCHANNELS_HEADERSIZE);
+	DataHelper::SetInt32(header+8, output);
+	DataHelper::SetInt32(header+12, address);
+	DataHelper::SetUint64(header+16, stamp);
+	struct iovec iov[2];
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = (void *)values;
+	iov[1].iov_len = count;
+	WriteVector(MSG_SETCHANNELS, iov, count > 0 ? 2 : 1);
+}
+
+// Flush the outbound queue when the event loop reports that the pipe is writable
+void IPC::SetEventLoop(EventLoop *loop)
+{
+	WatchWritable(false);
+	mLoop = loop;
+	WatchWritable(mOutCount > 0);
+}
+
+// Set the maximum number of queued bytes and what to drop when it is reached
+void IPC::SetQueueLimit(size_t size, IPCDropPolicy_t policy)
+{
+	mQueueLimit = size;
+	mDropPolicy = policy;
+}
+
+// Use shared memory instead of the pipe to send channel values
+void IPC::SetSharedUniverse(SharedUniverse *shared)
+{
+	mShared = shared;
+}
+
+// This function returns the next message which is received from the pipe
+const IPCMessage *IPC::GetMessage()
+{
+	while(mEntryCount > 0)
+	{
+		Entry &entry = mEntries[mEntryHead];
+		mEntryHead = (mEntryHead + 1) % mEntries.size();
+		mEntryCount--;
+		if(entry.removed)
+			continue;
+		mAvailableMessages--;
+		mCurrent.SetView(entry.type, entry.size, entry.size > 0 ? mReadBuffer + entry.offset : NULL);
+		return &mCurrent;
+	}
+	return NULL;
 }
 
 // This function returns the number of received messages
 int IPC::GetAvailableMessages()
 {
-	return mMessageQueue.size();
-}
\ No newline at end of file
+	return mAvailableMessages;
+}
+
+// This function returns the number of messages that are completely sent
+uint64_t IPC::GetSentMessages() const
+{
+	return mSentMessages;
+}
+
+// This function returns the number of received channel messages that were
+// dropped because a newer message for the same channels was received
+uint64_t IPC::GetCoalescedMessages() const
+{
+	return mCoalescedMessages;
+}
+
+// Number of bytes that are waiting to be written
+size_t IPC::GetPendingBytes() const
+{
+	return mPendingBytes;
+}
+
+// Total number of bytes that had to be queued because the pipe was full
+uint64_t IPC::GetQueuedBytes() const
+{
+	return mQueuedBytes;
+}
+
+// Number of channel frames that were dropped because the queue was full
+uint64_t IPC::GetDroppedFrames() const
+{
+	return mDroppedFrames;
+}
+
+// Largest number of bytes that were waiting at the same time
+size_t IPC::GetQueueHighWater() const
+{
+	return mQueueHighWater;
+}
+
+// Log the queue statistics when something was queued since the last report
+void IPC::ReportQueueStatistics(const char *name)
+{
+	if(mQueuedBytes == mReportedQueuedBytes && mDroppedFrames == mReportedDroppedFrames)
+		return;
+	Inform("%s: %llu bytes queued, %llu frames dropped, high-water mark %lu bytes", name,
+		(unsigned long long)(mQueuedBytes - mReportedQueuedBytes),
+		(unsigned long long)(mDroppedFrames - mReportedDroppedFrames),
+		(unsigned long)mQueueHighWater);
+	mReportedQueuedBytes = mQueuedBytes;
+	mReportedDroppedFrames = mDroppedFrames;
+	mQueueHighWater = mPendingBytes;
+}
+
+// Gauge that is set to the number of bytes waiting to be written
+void IPC::SetQueueMetric(Metric_t metric)
+{
+	mQueueMetric = metric;
+}
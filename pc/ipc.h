@@ -23,9 +23,40 @@ THE SOFTWARE.*/
 #define _IPC_H_
 
 #include <string>
-#include <queue>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include "shareduniverse.h"
+#include "metrics.h"
 
+// Initial size of the receive buffer, it grows when a message does not fit
 #define IPC_RECEIVINGBUFFERSIZE 8192
+// Messages larger than this are considered a protocol error
+#define IPC_MAXMESSAGESIZE (1024*1024)
+// Initial number of queued messages, the queue grows when it is full
+#define IPC_QUEUESIZE 64
+// Payloads up to this size are stored inside the IPCMessage
+#define IPCMESSAGE_INLINESIZE 16
+// Default maximum number of bytes waiting to be written to the pipe
+#define IPC_OUTQUEUESIZE 65536
+// Maximum number of frames that are written with a single writev
+#define IPC_MAXWRITEFRAMES 64
+
+class EventLoop;
+
+// What happens to channel frames when the outbound queue is full
+enum IPCDropPolicy_t {
+	// Drop queued frames that are overwritten by a newer frame, then the oldest
+	IPC_DROP_STALE,
+	// Drop the oldest queued frames
+	IPC_DROP_OLDEST,
+	// Drop the frame that is being sent
+	IPC_DROP_NEWEST,
+};
+
+// Convert the name of a drop policy (stale, oldest, newest) to the policy
+IPCDropPolicy_t ParseDropPolicy(const std::string &name);
 
 // Protocol used for IPC:
 // 4 bytes int type
@@ -33,16 +64,16 @@ THE SOFTWARE.*/
 // n bytes for data
 
 // Inter process communication message
+// A message either owns its data or is a view into the receive buffer of IPC
 class IPCMessage 
 {
 public:
-	// Constructor for IPCMessage
-	// data is a pointer to the raw received data
-	IPCMessage(const unsigned char *data);
 	// Empty constructor
 	IPCMessage();
-	// Constructor for setting the data
+	// Constructor for setting the data, the data is copied
 	IPCMessage(int type, int size, const void *data);
+	// Constructor that reserves size bytes of data, fill them using GetBuffer
+	IPCMessage(int type, int size);
 	// Destructor for IPCMessage
 	~IPCMessage();
 	
@@ -51,13 +82,26 @@ public:
 	// Get the data
 	const void *GetData() const;
 	int GetDataSize() const;
+	// Get the data for writing, only valid for messages that own their data
+	void *GetBuffer();
 	// Function that returns an human readable representation of the mesage
 	std::string ToString() const;	
 	
 private:
+	friend class IPC;
+	// Make the message refer to data that is owned by somebody else
+	void SetView(int type, int size, const void *data);
+	void Release();
+	
 	int mType;
 	void *mData;
 	int mSize;
+	bool mOwned;
+	unsigned char mInline[IPCMESSAGE_INLINESIZE];
+	
+	// Messages can't be copied
+	IPCMessage(const IPCMessage &);
+	IPCMessage &operator=(const IPCMessage &);
 };
 
 // Inter process communication class 
@@ -72,20 +116,142 @@ public:
 	
 	// This function reads data from the pipe and tries to create an message from it
 	// This function needs to be called periodically to prevent buffer overflows
+	// Messages returned by GetMessage are no longer valid after calling Tick
 	void Tick();
 	// Send an message to the other side
 	void SendMessage(const IPCMessage &message);
-	// This function returns an message in message which is received from the pipe
-	// Returns true when successful
-	IPCMessage *GetMessage();
+	// Send an message to the other side without creating an IPCMessage
+	void SendMessage(int type, int size, const void *data);
+	// Send channel values of an output to the other side
+	// The values are written to the shared universe when one is used
+	// stamp is the receive time of the frame on the realtime clock, 0 when unknown
+	void SendChannels(int output, int address, int count, const uint8_t *values, uint64_t stamp = 0);
+	// Use shared memory instead of the pipe to send channel values
+	void SetSharedUniverse(SharedUniverse *shared);
+	// Flush the outbound queue when the event loop reports that the pipe is
+	// writable. Without an event loop the queue is flushed by Tick and Send*
+	void SetEventLoop(EventLoop *loop);
+	// Set the maximum number of queued bytes and what to drop when it is reached
+	// Only channel frames are dropped, other messages are always queued
+	void SetQueueLimit(size_t size, IPCDropPolicy_t policy);
+	// Write as much of the outbound queue as possible
+	void Flush();
+	// This function returns the next message which is received from the pipe
+	// The message refers to the receive buffer and is valid until the next
+	// call to GetMessage or Tick. Returns NULL when there are no messages
+	const IPCMessage *GetMessage();
 	// This function returns the number of received messages
 	int GetAvailableMessages();
+	// This function returns the number of messages that are completely sent
+	uint64_t GetSentMessages() const;
+	// This function returns the number of received channel messages that were
+	// dropped because a newer message for the same channels was received
+	uint64_t GetCoalescedMessages() const;
+	// Number of bytes that are waiting to be written
+	size_t GetPendingBytes() const;
+	// Total number of bytes that had to be queued because the pipe was full
+	uint64_t GetQueuedBytes() const;
+	// Number of channel frames that were dropped because the queue was full
+	uint64_t GetDroppedFrames() const;
+	// Largest number of bytes that were waiting at the same time
+	size_t GetQueueHighWater() const;
+	// Log the queue statistics when something was queued since the last
+	// report and reset the high-water mark
+	void ReportQueueStatistics(const char *name);
+	// Gauge that is set to the number of bytes waiting to be written
+	void SetQueueMetric(Metric_t metric);
 private:
+	// Received message in the receive buffer
+	struct Entry {
+		int type;
+		int size;
+		// Offset of the data in the receive buffer
+		size_t offset;
+		// Set when the message is superseded
+		bool removed;
+	};
+	
+	// Message in the outbound queue
+	struct OutFrame {
+		int type;
+		// Offset of the header in the outbound buffer
+		size_t offset;
+		// Size including the header
+		size_t size;
+		// Channels that are set by a MSG_SETCHANNELS frame
+		int output;
+		int address;
+		int count;
+		// Set when the frame is dropped before it was written
+		bool dropped;
+	};
+	
+	// Decode the complete messages in the receive buffer
+	void ParseMessages();
+	// Add a decoded message to the queue
+	void PushEntry(int type, int size, size_t offset);
+	// Remove the queued channel messages that are superseded by the entry
+	void Coalesce(const Entry &entry);
+	// Make room at the end of the receive buffer for at least size bytes
+	void ReserveReadBuffer(size_t size);
+	// Write a message consisting of count parts to the pipe, the part that
+	// could not be written is queued
+	void WriteVector(int type, struct iovec *iov, int count);
+	// Add a message to the outbound queue, written bytes are already sent
+	void QueueFrame(int type, const struct iovec *iov, int count, size_t written);
+	// Make room for a frame of size bytes according to the drop policy
+	// Returns false when the frame itself has to be dropped
+	bool MakeRoom(const OutFrame &frame);
+	void DropFrame(OutFrame &frame);
+	// Make room at the end of the outbound buffer for at least size bytes
+	void ReserveWriteBuffer(size_t size);
+	// Start or stop waiting for the pipe to become writable
+	void WatchWritable(bool watch);
+	static void HandleWritable(int fd, uint32_t events, void *data);
+
 	int mReadFd;
 	int mWriteFd;
-	std::queue<IPCMessage *> mMessageQueue;
-	int mReadingBufferSize;
-	unsigned char mReadingBuffer[IPC_RECEIVINGBUFFERSIZE];
+	uint64_t mSentMessages;
+	uint64_t mCoalescedMessages;
+	
+	// Receive buffer, bytes before mReadStart are no longer used
+	unsigned char *mReadBuffer;
+	size_t mReadCapacity;
+	size_t mReadStart;
+	size_t mReadEnd;
+	// Start of the first message that is not decoded yet
+	size_t mParsePos;
+	
+	// Queue of received messages, a ring buffer of entries
+	std::vector<Entry> mEntries;
+	size_t mEntryHead;
+	size_t mEntryCount;
+	int mAvailableMessages;
+	// Message that was last returned by GetMessage
+	IPCMessage mCurrent;
+	
+	// Outbound queue, the frames are stored back to back in mWriteBuffer
+	unsigned char *mWriteBuffer;
+	size_t mWriteCapacity;
+	size_t mWriteEnd;
+	std::vector<OutFrame> mOutFrames;
+	size_t mOutHead;
+	size_t mOutCount;
+	// Bytes of the first frame that are already written
+	size_t mOutWritten;
+	size_t mPendingBytes;
+	size_t mQueueLimit;
+	IPCDropPolicy_t mDropPolicy;
+	uint64_t mQueuedBytes;
+	uint64_t mDroppedFrames;
+	size_t mQueueHighWater;
+	Metric_t mQueueMetric;
+	uint64_t mReportedQueuedBytes;
+	uint64_t mReportedDroppedFrames;
+	EventLoop *mLoop;
+	bool mWatchingWritable;
+	
+	SharedUniverse *mShared;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,109 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "logger.h"
+#include "latencyhistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+	for(int i = 0; i < LATENCYHISTOGRAM_BUCKETS; i++)
+	{
+		mBuckets[i].store(0, std::memory_order_relaxed);
+		mReported[i] = 0;
+	}
+	mSum.store(0, std::memory_order_relaxed);
+	mMax.store(0, std::memory_order_relaxed);
+	mReportedSum = 0;
+}
+
+int LatencyHistogram::GetBucket(uint64_t ns)
+{
+	// Microseconds, a shift is cheaper than a division
+	uint64_t us = ns >> 10;
+	if(us < LATENCYHISTOGRAM_SUBBUCKETS)
+		return us;
+	int msb = 63 - __builtin_clzll(us);
+	int sub = (us >> (msb - 2)) & (LATENCYHISTOGRAM_SUBBUCKETS - 1);
+	int bucket = (msb - 1) * LATENCYHISTOGRAM_SUBBUCKETS + sub;
+	return bucket < LATENCYHISTOGRAM_BUCKETS ? bucket : LATENCYHISTOGRAM_BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::GetBucketLimit(int bucket)
+{
+	bucket++;
+	if(bucket < LATENCYHISTOGRAM_SUBBUCKETS)
+		return (uint64_t)bucket << 10;
+	int msb = bucket / LATENCYHISTOGRAM_SUBBUCKETS + 1;
+	int sub = bucket % LATENCYHISTOGRAM_SUBBUCKETS;
+	return (uint64_t)(LATENCYHISTOGRAM_SUBBUCKETS + sub) << (msb - 2) << 10;
+}
+
+void LatencyHistogram::Add(uint64_t ns)
+{
+	mBuckets[GetBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+	mSum.fetch_add(ns, std::memory_order_relaxed);
+	uint64_t max = mMax.load(std::memory_order_relaxed);
+	while(ns > max && !mMax.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::AddSince(uint64_t stamp, uint64_t now)
+{
+	if(stamp != 0 && now >= stamp)
+		Add(now - stamp);
+}
+
+uint64_t LatencyHistogram::GetPercentile(const uint64_t *counts, uint64_t total, double fraction) const
+{
+	uint64_t target = (uint64_t)(total * fraction);
+	uint64_t seen = 0;
+	for(int i = 0; i < LATENCYHISTOGRAM_BUCKETS; i++)
+	{
+		seen += counts[i];
+		if(seen > target)
+			return GetBucketLimit(i);
+	}
+	return GetBucketLimit(LATENCYHISTOGRAM_BUCKETS - 1);
+}
+
+void LatencyHistogram::Report(const char *name)
+{
+	uint64_t counts[LATENCYHISTOGRAM_BUCKETS];
+	uint64_t total = 0;
+	for(int i = 0; i < LATENCYHISTOGRAM_BUCKETS; i++)
+	{
+		uint64_t count = mBuckets[i].load(std::memory_order_relaxed);
+		counts[i] = count - mReported[i];
+		mReported[i] = count;
+		total += counts[i];
+	}
+	uint64_t sum = mSum.load(std::memory_order_relaxed);
+	uint64_t average = total > 0 ? (sum - mReportedSum) / total : 0;
+	mReportedSum = sum;
+	uint64_t max = mMax.exchange(0, std::memory_order_relaxed);
+	if(total == 0)
+		return;
+	
+	Inform("%s: %llu samples, avg %.1fus, p50 < %.1fus, p99 < %.1fus, p99.9 < %.1fus, max %.1fus",
+		name, (unsigned long long)total, average / 1000.0,
+		GetPercentile(counts, total, 0.5) / 1000.0, GetPercentile(counts, total, 0.99) / 1000.0,
+		GetPercentile(counts, total, 0.999) / 1000.0, max / 1000.0);
+}
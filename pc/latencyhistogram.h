@@ -0,0 +1,67 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _LATENCYHISTOGRAM_H_
+#define _LATENCYHISTOGRAM_H_
+
+#include <stdint.h>
+#include <atomic>
+
+// Every power of two of microseconds is split in this many buckets
+#define LATENCYHISTOGRAM_SUBBUCKETS 4
+// The last bucket holds the samples of 2^24 us (16.8 s) and more
+#define LATENCYHISTOGRAM_BUCKETS (24 * LATENCYHISTOGRAM_SUBBUCKETS)
+
+// Histogram of latency samples in nanoseconds with logarithmic buckets
+// Samples are added with relaxed atomic increments, so any thread can add
+// samples without locks while another thread reports. The precision of the
+// percentiles is about 25%, which is enough to find the stage that is slow.
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+	
+	// Add a sample, can be called from any thread
+	void Add(uint64_t ns);
+	// Add the time from stamp to now, both on the realtime clock
+	// Stamps of 0 and stamps in the future are ignored
+	void AddSince(uint64_t stamp, uint64_t now);
+	
+	// Log the percentiles of the samples since the last report with the given name
+	// Only one thread may report
+	void Report(const char *name);
+	
+private:
+	static int GetBucket(uint64_t ns);
+	// Returns the upper limit of the bucket in ns
+	static uint64_t GetBucketLimit(int bucket);
+	// Returns the upper limit of the bucket that contains the fraction of the samples
+	uint64_t GetPercentile(const uint64_t *counts, uint64_t total, double fraction) const;
+	
+	std::atomic<uint64_t> mBuckets[LATENCYHISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> mSum;
+	std::atomic<uint64_t> mMax;
+	// Reporter state
+	uint64_t mReported[LATENCYHISTOGRAM_BUCKETS];
+	uint64_t mReportedSum;
+};
+
+#endif
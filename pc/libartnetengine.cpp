@@ -0,0 +1,130 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifdef HAVE_LIBARTNET
+
+#include <cstring>
+#include <cassert>
+#include "logger.h"
+#include "settings.h"
+#include "timehelper.h"
+#include "outputconfig.h"
+#include "libartnetengine.h"
+
+LibArtNetEngine::LibArtNetEngine(std::string ip, MergeEngine *merge)
+{
+	assert(merge != NULL);
+	mMerge = merge;
+	mStarted = false;
+	mPortCount = 0;
+	
+	mNode = artnet_new(ip.c_str(), 0);
+	if(mNode == NULL) {
+		Error("Could not create Art-Net node");
+		return;
+	}
+	
+	std::vector<OutputConfig> outputs = GetOutputConfigs();
+	unsigned short subnet = outputs[0].portAddress >> 4;
+	if((subnet >> 4) != 0)
+	{
+		Warn("libartnet does not support Art-Net nets, ignoring the net");
+	}
+	
+	artnet_set_short_name(mNode, Settings::GetArtNetShortName().c_str());
+	artnet_set_long_name(mNode, Settings::GetArtNetLongName().c_str());
+	artnet_set_node_type(mNode, ARTNET_NODE);
+	artnet_set_subnet_addr(mNode, subnet & 0x0F);
+	
+	// libartnet has a limited number of ports that all share one subnet
+	// Ports are mapped to outputs by index, so the first unsupported output ends the list
+	for(size_t i = 0; i < outputs.size(); i++)
+	{
+		if(mPortCount == ARTNET_MAX_PORTS || (int)i != mPortCount ||
+			(outputs[i].portAddress >> 4) != subnet)
+		{
+			Warn("libartnet can not output port address %d:%d:%d, ignoring the output",
+				outputs[i].portAddress >> 8, (outputs[i].portAddress >> 4) & 0x0F,
+				outputs[i].portAddress & 0x0F);
+			continue;
+		}
+		artnet_set_port_type(mNode, mPortCount, ARTNET_ENABLE_OUTPUT, ARTNET_PORT_DMX);
+		artnet_set_port_addr(mNode, mPortCount, ARTNET_OUTPUT_PORT, outputs[i].portAddress & 0x0F);
+		mPortCount++;
+	}
+	
+	if(artnet_set_dmx_handler(mNode, DmxHandler, this)) {
+		Error("Failed to install handler");
+		return;
+	}
+	
+	if(artnet_start(mNode) != 0) {
+		Error("Could not start Art-Net node");
+		return;
+	}
+	mStarted = true;
+}
+
+LibArtNetEngine::~LibArtNetEngine()
+{
+	if(mNode != NULL)
+	{
+		if(mStarted)
+			artnet_stop(mNode);
+		artnet_destroy(mNode);
+	}
+}
+
+bool LibArtNetEngine::IsValid() const
+{
+	return mStarted;
+}
+
+int LibArtNetEngine::GetSocket() const
+{
+	return artnet_get_sd(mNode);
+}
+
+void LibArtNetEngine::Tick()
+{
+	assert(IsValid());
+	artnet_read(mNode, 0);
+}
+
+int LibArtNetEngine::DmxHandler(artnet_node n, int port, void *d)
+{
+	LibArtNetEngine *engine = (LibArtNetEngine *)d;
+	
+	if(port >= 0 && port < engine->mPortCount) {
+		int len;
+		uint8_t *data = artnet_read_dmx(n, port, &len);
+		// libartnet already merges its sources, so the port is a single source
+		// libartnet does not pass the receive time stamps of the datagrams
+		engine->mMerge->SetFrame(port, 0, MERGE_DEFAULTPRIORITY, data, len, GetMonotonicTime(),
+			GetRealTime());
+		engine->mMerge->Flush();
+	}
+	
+	return 0;
+}
+
+#endif
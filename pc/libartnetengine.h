@@ -0,0 +1,55 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _LIBARTNETENGINE_H_
+#define _LIBARTNETENGINE_H_
+
+#ifdef HAVE_LIBARTNET
+
+#include <string>
+#include <artnet/artnet.h>
+#include "mergeengine.h"
+#include "artnetengine.h"
+
+// Art-Net node implemented with libartnet
+class LibArtNetEngine : public ArtNetEngine
+{
+public:
+	LibArtNetEngine(std::string ip, MergeEngine *merge);
+	~LibArtNetEngine();
+	
+	bool IsValid() const;
+	int GetSocket() const;
+	void Tick();
+	
+private:
+	static int DmxHandler(artnet_node n, int port, void *d);
+	
+	artnet_node mNode;
+	bool mStarted;
+	// Number of libartnet ports in use, port i outputs to output i
+	int mPortCount;
+	MergeEngine *mMerge;
+};
+
+#endif
+
+#endif
@@ -25,6 +25,13 @@ THE SOFTWARE.*/
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include "logger.h"
 
 void syslogLoggerImpl(enum LogLevel level, const char *format, va_list arg);
@@ -81,48 +88,562 @@ void syslogLoggerImpl(enum LogLevel level, const char *format, va_list arg)
 void stdoutLoggerImpl(enum LogLevel level, const char *format, va_list arg)
 {
 	assert(format != NULL);
-	char *extendedFormat = (char *) malloc(strlen(format)+15);
+	const char *prefix;
 	switch(level)
 	{
 		case LOGDEBUG:
-			strcpy(extendedFormat, "DEBUG: ");
+			prefix = "DEBUG: ";
 			break;
 		case LOGINFORM:
-			strcpy(extendedFormat, "INFORM: ");
+			prefix = "INFORM: ";
 			break;
 		case LOGNOTICE:
-			strcpy(extendedFormat, "NOTICE: ");
+			prefix = "NOTICE: ";
 			break;
 		case LOGWARN:
-			strcpy(extendedFormat, "WARN: ");
+			prefix = "WARN: ";
 			break;
 		case LOGERROR:
-			strcpy(extendedFormat, "ERROR: ");
+			prefix = "ERROR: ";
 			break;
 		case LOGCRITICAL:
-			strcpy(extendedFormat, "CRITICAL: ");
+			prefix = "CRITICAL: ";
 			break;
 		default:
-			strcpy(extendedFormat, "");
+			prefix = "";
 			break;
 	}
-	strcat(extendedFormat, format);
-	strcat(extendedFormat, "\n");
-	vfprintf(stdout, extendedFormat, arg);
-	free(extendedFormat);
+	// Keep the line together when several threads log
+	flockfile(stdout);
+	fputs(prefix, stdout);
+	vfprintf(stdout, format, arg);
+	fputc('\n', stdout);
+	funlockfile(stdout);
 }
 
 // Send the log message to all registered loggers
-void vLogger(enum LogLevel level, const char *format, va_list arg)
+void SendToLoggers(enum LogLevel level, const char *format, va_list arg)
 {
 	struct LoggerNode *node = rootLogger;
 	while(node != NULL)
 	{
-		node->logger(level, format, arg);
+		// Every logger consumes the arguments
+		va_list copy;
+		va_copy(copy, arg);
+		node->logger(level, format, copy);
+		va_end(copy);
 		node = node->next;
 	}
 }
 
+// Send an already formatted message to all registered loggers
+void SendMessageToLoggers(enum LogLevel level, const char *format, ...)
+{
+	va_list a_list;
+	va_start(a_list, format);
+	SendToLoggers(level, format, a_list);
+	va_end(a_list);
+}
+
+//
+// Rate limiting
+//
+
+// Messages are counted per format string
+struct RateSlot {
+	const char *format;
+	uint64_t windowStart;
+	unsigned int count;
+	unsigned int suppressed;
+};
+
+struct RateSlot rateSlots[LOGGER_RATESLOTS];
+
+uint64_t GetCoarseTimeMs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Returns 0 when the message must be suppressed, else 1 and the number of
+// messages with the same format that were suppressed before it
+// Threads that race on a slot can only make the counts slightly off
+int CheckRateLimit(const char *format, unsigned int *suppressed)
+{
+	struct RateSlot *slot = &rateSlots[((uintptr_t)format >> 3) % LOGGER_RATESLOTS];
+	uint64_t now = GetCoarseTimeMs();
+	*suppressed = 0;
+	if(__atomic_load_n(&slot->format, __ATOMIC_RELAXED) != format)
+	{
+		// Another format used the slot, start counting again
+		__atomic_store_n(&slot->format, format, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->windowStart, now, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->count, 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->suppressed, 0, __ATOMIC_RELAXED);
+		return 1;
+	}
+	if(now - __atomic_load_n(&slot->windowStart, __ATOMIC_RELAXED) >= LOGGER_RATEINTERVAL)
+	{
+		__atomic_store_n(&slot->windowStart, now, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->count, 1, __ATOMIC_RELAXED);
+		*suppressed = __atomic_exchange_n(&slot->suppressed, 0, __ATOMIC_RELAXED);
+		return 1;
+	}
+	if(__atomic_add_fetch(&slot->count, 1, __ATOMIC_RELAXED) > LOGGER_RATEBURST)
+	{
+		__atomic_add_fetch(&slot->suppressed, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	return 1;
+}
+
+//
+// Format strings
+//
+
+// Kind of the argument of a conversion
+enum LogArgKind {
+	LOGARG_NONE,
+	LOGARG_SIGNED,
+	LOGARG_UNSIGNED,
+	LOGARG_CHAR,
+	LOGARG_DOUBLE,
+	LOGARG_STRING,
+	LOGARG_POINTER,
+	LOGARG_UNSUPPORTED,
+};
+
+// A conversion specification of a format string
+struct LogSpec {
+	// Characters of the specification, including the %
+	int length;
+	// Characters before the length modifier
+	int prefixLength;
+	// Number of * widths and precisions
+	int stars;
+	// Length modifier, H is hh and q is ll
+	char modifier;
+	enum LogArgKind kind;
+};
+
+// Parse the conversion specification that starts at the % in format
+void ParseSpec(const char *format, struct LogSpec *spec)
+{
+	int i = 1;
+	spec->stars = 0;
+	while(format[i] != '\0' && strchr("-+ #0'", format[i]) != NULL)
+		i++;
+	if(format[i] == '*')
+	{
+		spec->stars++;
+		i++;
+	}
+	while(format[i] >= '0' && format[i] <= '9')
+		i++;
+	if(format[i] == '.')
+	{
+		i++;
+		if(format[i] == '*')
+		{
+			spec->stars++;
+			i++;
+		}
+		while(format[i] >= '0' && format[i] <= '9')
+			i++;
+	}
+	spec->prefixLength = i;
+	spec->modifier = 0;
+	if(format[i] == 'h' && format[i + 1] == 'h')
+	{
+		spec->modifier = 'H';
+		i += 2;
+	} else if(format[i] == 'l' && format[i + 1] == 'l') {
+		spec->modifier = 'q';
+		i += 2;
+	} else if(format[i] != '\0' && strchr("hlqjztL", format[i]) != NULL) {
+		spec->modifier = format[i];
+		i++;
+	}
+	char conversion = format[i];
+	switch(conversion)
+	{
+		case '%':
+			spec->kind = LOGARG_NONE;
+			break;
+		case 'd':
+		case 'i':
+			spec->kind = LOGARG_SIGNED;
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			spec->kind = LOGARG_UNSIGNED;
+			break;
+		case 'c':
+			spec->kind = spec->modifier == 0 ? LOGARG_CHAR : LOGARG_UNSUPPORTED;
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			spec->kind = LOGARG_DOUBLE;
+			break;
+		case 's':
+			spec->kind = spec->modifier == 0 ? LOGARG_STRING : LOGARG_UNSUPPORTED;
+			break;
+		case 'p':
+			spec->kind = LOGARG_POINTER;
+			break;
+		default:
+			spec->kind = LOGARG_UNSUPPORTED;
+			break;
+	}
+	spec->length = conversion == '\0' ? i : i + 1;
+}
+
+//
+// Asynchronous logging
+//
+
+union LogArg {
+	long long i;
+	unsigned long long u;
+	double d;
+	const void *p;
+};
+
+// A message waiting in the ring buffer
+// Only the format pointer and the arguments are stored, strings are copied
+// into strings
+struct LogRecord {
+	// Position in the ring at which the record may be written or read
+	size_t sequence;
+	enum LogLevel level;
+	const char *format;
+	unsigned int suppressed;
+	int argCount;
+	union LogArg args[LOGGER_MAXARGS];
+	char strings[LOGGER_STRINGSIZE];
+};
+
+struct LogRecord logRing[LOGGER_RINGSIZE];
+// Next position to write, shared by all threads
+size_t logHead;
+// Next position to read, only used by the logger thread
+size_t logTail;
+// Records lost because the ring was full
+unsigned int logDropped;
+// Counts the records that are written, the logger thread waits on it
+sem_t logSemaphore;
+pthread_t logThread;
+int logRunning = 0;
+int logStopping;
+
+// Copy the arguments that format uses into the record
+// Stops at the first conversion that is not supported, the formatter outputs
+// the rest of the format as it is
+void StoreArguments(struct LogRecord *record, const char *format, va_list arg)
+{
+	int stringsUsed = 0;
+	record->argCount = 0;
+	const char *p = format;
+	while((p = strchr(p, '%')) != NULL)
+	{
+		struct LogSpec spec;
+		ParseSpec(p, &spec);
+		p += spec.length;
+		if(spec.kind == LOGARG_NONE)
+			continue;
+		if(spec.kind == LOGARG_UNSUPPORTED || record->argCount + spec.stars + 1 > LOGGER_MAXARGS)
+			return;
+		for(int i = 0; i < spec.stars; i++)
+		{
+			record->args[record->argCount++].i = va_arg(arg, int);
+		}
+		union LogArg *value = &record->args[record->argCount++];
+		switch(spec.kind)
+		{
+			case LOGARG_SIGNED:
+				switch(spec.modifier)
+				{
+					case 'H': value->i = (signed char)va_arg(arg, int); break;
+					case 'h': value->i = (short)va_arg(arg, int); break;
+					case 'l': value->i = va_arg(arg, long); break;
+					case 'q': value->i = va_arg(arg, long long); break;
+					case 'j': value->i = va_arg(arg, intmax_t); break;
+					case 'z': value->i = (long long)va_arg(arg, size_t); break;
+					case 't': value->i = va_arg(arg, ptrdiff_t); break;
+					default: value->i = va_arg(arg, int); break;
+				}
+				break;
+			case LOGARG_UNSIGNED:
+				switch(spec.modifier)
+				{
+					case 'H': value->u = (unsigned char)va_arg(arg, unsigned int); break;
+					case 'h': value->u = (unsigned short)va_arg(arg, unsigned int); break;
+					case 'l': value->u = va_arg(arg, unsigned long); break;
+					case 'q': value->u = va_arg(arg, unsigned long long); break;
+					case 'j': value->u = va_arg(arg, uintmax_t); break;
+					case 'z': value->u = va_arg(arg, size_t); break;
+					case 't': value->u = (unsigned long long)va_arg(arg, ptrdiff_t); break;
+					default: value->u = va_arg(arg, unsigned int); break;
+				}
+				break;
+			case LOGARG_CHAR:
+				value->i = va_arg(arg, int);
+				break;
+			case LOGARG_DOUBLE:
+				if(spec.modifier == 'L')
+					value->d = (double)va_arg(arg, long double);
+				else
+					value->d = va_arg(arg, double);
+				break;
+			case LOGARG_STRING:
+			{
+				const char *string = va_arg(arg, const char *);
+				if(string == NULL)
+					string = "(null)";
+				// Store the offset of the copy, truncate when the space is used up
+				size_t length = strlen(string);
+				size_t space = LOGGER_STRINGSIZE - stringsUsed - 1;
+				if(length > space)
+					length = space;
+				memcpy(record->strings + stringsUsed, string, length);
+				record->strings[stringsUsed + length] = '\0';
+				value->u = stringsUsed;
+				stringsUsed += length + 1;
+				if(stringsUsed >= LOGGER_STRINGSIZE)
+					stringsUsed = LOGGER_STRINGSIZE - 1;
+				break;
+			}
+			case LOGARG_POINTER:
+				value->p = va_arg(arg, const void *);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+// Format the message of a record
+void FormatRecord(const struct LogRecord *record, char *message, size_t size)
+{
+	size_t used = 0;
+	int argIndex = 0;
+	const char *p = record->format;
+	message[0] = '\0';
+	while(*p != '\0' && used < size - 1)
+	{
+		if(*p != '%')
+		{
+			message[used++] = *p++;
+			continue;
+		}
+		struct LogSpec spec;
+		ParseSpec(p, &spec);
+		if(spec.kind == LOGARG_NONE)
+		{
+			message[used++] = '%';
+			p += spec.length;
+			continue;
+		}
+		if(spec.kind == LOGARG_UNSUPPORTED || argIndex + spec.stars + 1 > record->argCount)
+		{
+			// The arguments were not stored, output the format as it is
+			size_t length = strlen(p);
+			if(length > size - 1 - used)
+				length = size - 1 - used;
+			memcpy(message + used, p, length);
+			used += length;
+			break;
+		}
+		// Rebuild the specification for the stored type of the value
+		char format[32];
+		int length = spec.prefixLength < 28 ? spec.prefixLength : 28;
+		memcpy(format, p, length);
+		if(spec.kind == LOGARG_SIGNED || spec.kind == LOGARG_UNSIGNED)
+		{
+			format[length++] = 'l';
+			format[length++] = 'l';
+		}
+		format[length++] = p[spec.length - 1];
+		format[length] = '\0';
+		p += spec.length;
+		
+		int stars[2] = {0, 0};
+		for(int i = 0; i < spec.stars; i++)
+		{
+			stars[i] = (int)record->args[argIndex++].i;
+		}
+		const union LogArg *value = &record->args[argIndex++];
+		char *out = message + used;
+		size_t space = size - used;
+		int written = 0;
+#define FORMATARG(arg) \
+		(spec.stars == 0 ? snprintf(out, space, format, arg) : \
+		spec.stars == 1 ? snprintf(out, space, format, stars[0], arg) : \
+		snprintf(out, space, format, stars[0], stars[1], arg))
+		switch(spec.kind)
+		{
+			case LOGARG_SIGNED: written = FORMATARG(value->i); break;
+			case LOGARG_UNSIGNED: written = FORMATARG(value->u); break;
+			case LOGARG_CHAR: written = FORMATARG((int)value->i); break;
+			case LOGARG_DOUBLE: written = FORMATARG(value->d); break;
+			case LOGARG_STRING: written = FORMATARG(record->strings + value->u); break;
+			case LOGARG_POINTER: written = FORMATARG(value->p); break;
+			default: break;
+		}
+#undef FORMATARG
+		if(written > 0)
+			used += (size_t)written < space ? (size_t)written : space - 1;
+	}
+	message[used] = '\0';
+}
+
+// Put a message in the ring buffer, drops the message when the ring is full
+void PushRecord(enum LogLevel level, unsigned int suppressed, const char *format, va_list arg)
+{
+	size_t position = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+	struct LogRecord *record;
+	for(;;)
+	{
+		record = &logRing[position & (LOGGER_RINGSIZE - 1)];
+		size_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+		if(difference == 0)
+		{
+			// The record is free, claim it
+			if(__atomic_compare_exchange_n(&logHead, &position, position + 1, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if(difference < 0) {
+			// The logger thread did not read the record yet
+			__atomic_add_fetch(&logDropped, 1 + suppressed, __ATOMIC_RELAXED);
+			return;
+		} else {
+			position = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+		}
+	}
+	record->level = level;
+	record->format = format;
+	record->suppressed = suppressed;
+	StoreArguments(record, format, arg);
+	__atomic_store_n(&record->sequence, position + 1, __ATOMIC_RELEASE);
+	sem_post(&logSemaphore);
+}
+
+// Format and send all messages in the ring buffer
+void DrainRecords()
+{
+	char message[LOGGER_MESSAGESIZE];
+	for(;;)
+	{
+		struct LogRecord *record = &logRing[logTail & (LOGGER_RINGSIZE - 1)];
+		if(__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != logTail + 1)
+			break;
+		
+		unsigned int dropped = __atomic_exchange_n(&logDropped, 0, __ATOMIC_RELAXED);
+		if(dropped > 0)
+			SendMessageToLoggers(LOGWARN, "%u log messages were dropped because the log buffer was full", dropped);
+		if(record->suppressed > 0)
+			SendMessageToLoggers(record->level, "%u messages like the next one were suppressed", record->suppressed);
+		FormatRecord(record, message, sizeof(message));
+		SendMessageToLoggers(record->level, "%s", message);
+		
+		// Hand the record back to the writers
+		__atomic_store_n(&record->sequence, logTail + LOGGER_RINGSIZE, __ATOMIC_RELEASE);
+		logTail++;
+	}
+}
+
+void *LoggerThread(void *data)
+{
+	(void)data;
+	for(;;)
+	{
+		if(sem_wait(&logSemaphore) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		DrainRecords();
+		if(__atomic_load_n(&logStopping, __ATOMIC_ACQUIRE))
+			break;
+	}
+	DrainRecords();
+	return NULL;
+}
+
+int StartAsyncLogging()
+{
+	if(logRunning)
+		return 0;
+	for(size_t i = 0; i < LOGGER_RINGSIZE; i++)
+	{
+		logRing[i].sequence = i;
+	}
+	logHead = 0;
+	logTail = 0;
+	logDropped = 0;
+	logStopping = 0;
+	if(sem_init(&logSemaphore, 0, 0) < 0)
+		return -1;
+	
+	// The signals must be handled by the threads that log
+	sigset_t blocked;
+	sigset_t original;
+	sigfillset(&blocked);
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	pthread_attr_setstacksize(&attributes, LOGGER_STACKSIZE);
+	pthread_sigmask(SIG_BLOCK, &blocked, &original);
+	int result = pthread_create(&logThread, &attributes, LoggerThread, NULL);
+	pthread_sigmask(SIG_SETMASK, &original, NULL);
+	pthread_attr_destroy(&attributes);
+	if(result != 0)
+	{
+		sem_destroy(&logSemaphore);
+		return -1;
+	}
+	__atomic_store_n(&logRunning, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void StopAsyncLogging()
+{
+	if(!logRunning)
+		return;
+	// New messages are sent directly again
+	__atomic_store_n(&logRunning, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&logStopping, 1, __ATOMIC_RELEASE);
+	sem_post(&logSemaphore);
+	pthread_join(logThread, NULL);
+	sem_destroy(&logSemaphore);
+}
+
+// Send the log message to all registered loggers
+void vLogger(enum LogLevel level, const char *format, va_list arg)
+{
+	unsigned int suppressed;
+	if(!CheckRateLimit(format, &suppressed))
+		return;
+	if(__atomic_load_n(&logRunning, __ATOMIC_ACQUIRE))
+	{
+		PushRecord(level, suppressed, format, arg);
+		return;
+	}
+	if(suppressed > 0)
+		SendMessageToLoggers(level, "%u messages like the next one were suppressed", suppressed);
+	SendToLoggers(level, format, arg);
+}
+
 // Remove Node when there is no node after it
 void ClearLogger(struct LoggerNode *node)
 {
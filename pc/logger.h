@@ -28,6 +28,22 @@ extern "C" {
 
 #include <stdarg.h>
 
+// Number of records in the ring buffer of the asynchronous logger
+// Must be a power of two
+#define LOGGER_RINGSIZE 256
+// Maximum number of arguments of a record, including * widths
+#define LOGGER_MAXARGS 12
+// Space for the string arguments of a record, longer strings are truncated
+#define LOGGER_STRINGSIZE 192
+// Maximum length of a formatted message
+#define LOGGER_MESSAGESIZE 512
+// Messages with the same format are limited to LOGGER_RATEBURST messages
+// every LOGGER_RATEINTERVAL milliseconds
+#define LOGGER_RATESLOTS 64
+#define LOGGER_RATEBURST 20
+#define LOGGER_RATEINTERVAL 1000
+// Stack of the logger thread, small so locking the memory does not lock megabytes
+#define LOGGER_STACKSIZE (128 * 1024)
 
 // Different log levels
 enum LogLevel {
@@ -62,6 +78,18 @@ void AddLogger(const LogFunc_t logger);
 // Remove an logger
 void RemoveLogger(const LogFunc_t logger);
 
+// Format and send the messages on a background thread
+// The logging functions then only copy the format and the arguments into a
+// lock-free ring buffer, they never allocate, block or format. %s arguments
+// are copied, %n and wide characters are not supported.
+// Loggers must not be added or removed while the thread runs, and the thread
+// must be started again after a fork.
+// Returns 0 when successful
+int StartAsyncLogging();
+// Send the remaining messages and stop the background thread
+// Other threads must not log anymore
+void StopAsyncLogging();
+
 // Some default loggers
 extern const LogFunc_t syslogLogger;
 extern const LogFunc_t stdoutLogger;
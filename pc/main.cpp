@@ -32,6 +32,11 @@ THE SOFTWARE.*/
 #include "childs.h"
 #include "global.h"
 #include "logger.h"
+#include "stringhelper.h"
+#include "shareduniverse.h"
+#include "outputconfig.h"
+#include "metrics.h"
+#include "realtimehelper.h"
 
 // global state variables
 int running = 1;
@@ -125,6 +130,25 @@ int main(int argc, char **argv)
 		exit(EXIT_COULD_NOT_CREATE_CHILDS);
 	}
 	
+	// Create the shared memory for the channel values
+	SharedUniverse *shared = NULL;
+	if(ToLower(Settings::GetIPCTransport()) == "shm")
+	{
+		Debug("Creating the shared memory");
+		shared = new SharedUniverse(GetOutputConfigs().size());
+		if(!shared->IsValid())
+		{
+			Error("Could not create shared memory");
+			exit(EXIT_COULD_NOT_CREATE_CHILDS);
+		}
+	}
+	
+	// Share the metrics between both processes
+	if(!Metrics::Create())
+	{
+		Warn("Could not create the shared memory for the metrics");
+	}
+	
 	// Disconnect all loggers
 	closelog();
 	ClearLoggers();
@@ -140,6 +164,11 @@ int main(int argc, char **argv)
 		// Open the log file
 		openlog("DMXD_server", LOG_PID, LOG_DAEMON);
 		AddLogger(syslogLogger);
+		// Keep the formatting and syslog out of the event loops
+		if(StartAsyncLogging() != 0)
+		{
+			Warn("Could not start the logger thread, logging synchronously");
+		}
 		Inform("Starting DMX Server daemon");
 
 		sigaction(SIGTERM, &act, NULL);		
@@ -149,7 +178,7 @@ int main(int argc, char **argv)
 		setuid(user);
 		
 		// Start the child
-		result = serverChild(pipes2[0], pipes1[1]);
+		result = serverChild(pipes2[0], pipes1[1], shared);
 		
 		Inform("Stopping DMX Server daemon");
 		
@@ -158,18 +187,26 @@ int main(int argc, char **argv)
 		// Open the log file
 		openlog("DMXD_dmx", LOG_PID, LOG_DAEMON);
 		AddLogger(syslogLogger);
+		if(StartAsyncLogging() != 0)
+		{
+			Warn("Could not start the logger thread, logging synchronously");
+		}
 		Inform("Starting DMX daemon");
 
 			
 		// sent SIGHUP signal when parent dies
 		prctl(PR_SET_PDEATHSIG, SIGHUP);	
 		
+		// Keep the real-time settings usable after dropping root
+		RaiseRealtimeLimits(Settings::GetOutputPriority(),
+			ToLower(Settings::GetLockMemory()) == "on");
+		
 		// Change user
 		int user = Settings::GetDMXUser();
 		setuid(user);
 		
 		// Start the child
-		result = dmxChild(pipes1[0], pipes2[1]);
+		result = dmxChild(pipes1[0], pipes2[1], shared);
 		
 		Inform("Stopping DMX daemon");
 		
@@ -177,11 +214,13 @@ int main(int argc, char **argv)
 		kill(pid, SIGTERM);
 	}
 	
+	StopAsyncLogging();
 	closelog();
 	// Close all the pipes
 	close(pipes1[0]);
 	close(pipes1[1]);
 	close(pipes2[0]);
 	close(pipes2[1]);
+	delete shared;
 	return result;
 }
@@ -0,0 +1,334 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <cstring>
+#include <cassert>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+#include "logger.h"
+#include "timehelper.h"
+#include "metrics.h"
+#include "stringhelper.h"
+#include "mergeengine.h"
+
+MergeMode_t ParseMergeMode(const std::string &str)
+{
+	std::string mode = ToLower(str);
+	if(mode == "ltp")
+		return MERGE_LTP;
+	if(mode != "htp")
+		Warn("Unknown merge mode \"%s\", using htp", str.c_str());
+	return MERGE_HTP;
+}
+
+void MergeHtp(uint8_t *out, const uint8_t *in, int size)
+{
+	int i = 0;
+#if defined(__SSE2__)
+	for(; i + 16 <= size; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(out + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_max_epu8(a, b));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for(; i + 16 <= size; i += 16)
+	{
+		vst1q_u8(out + i, vmaxq_u8(vld1q_u8(out + i), vld1q_u8(in + i)));
+	}
+#endif
+	for(; i < size; i++)
+	{
+		if(in[i] > out[i])
+			out[i] = in[i];
+	}
+}
+
+MergeEngine::MergeEngine(IPC *ipc, int outputs, MergeMode_t mode, uint64_t timeout)
+{
+	assert(ipc != NULL);
+	assert(outputs > 0);
+	mIpc = ipc;
+	mMode = mode;
+	mTimeout = timeout;
+	mLowerPriority = 0;
+	mReportedLowerPriority = 0;
+	mMerged = 0;
+	mReportedMerged = 0;
+	mOutputs.resize(outputs);
+	for(int i = 0; i < outputs; i++)
+	{
+		Output &output = mOutputs[i];
+		memset(output.sources, 0, sizeof(output.sources));
+		memset(output.merged, 0, sizeof(output.merged));
+		output.priority = -1;
+		output.count = 0;
+		output.length = 0;
+		output.dirty = false;
+		output.stamp = 0;
+	}
+}
+
+void MergeEngine::SetFrame(int output, uint64_t source, int priority, const uint8_t *data, int length,
+	uint64_t now, uint64_t stamp)
+{
+	assert(output >= 0 && output < (int)mOutputs.size());
+	Output &out = mOutputs[output];
+	if(length > MERGE_MAXCHANNELS)
+		length = MERGE_MAXCHANNELS;
+	ExpireSources(out, output, now);
+	
+	Source *slot = NULL;
+	Source *free = NULL;
+	for(int i = 0; i < MERGE_MAXSOURCES; i++)
+	{
+		Source &s = out.sources[i];
+		if(s.time == 0)
+		{
+			if(free == NULL)
+				free = &s;
+		} else if(s.id == source) {
+			slot = &s;
+			break;
+		}
+	}
+	bool added = false;
+	if(slot == NULL)
+	{
+		// Ignore new sources when the output already has too many sources
+		if(free == NULL)
+			return;
+		slot = free;
+		slot->id = source;
+		slot->length = 0;
+		added = true;
+	}
+	bool changedPriority = added || slot->priority != priority;
+	slot->priority = priority;
+	slot->time = now;
+	
+	if(changedPriority && UpdatePriority(out))
+	{
+		// The sources that are merged changed, merge them all again
+		if(out.count > 1)
+			Inform("Merging %d sources on output %d", out.count, output);
+		StoreFrame(*slot, data, length);
+		Merge(out);
+		out.dirty = true;
+		out.stamp = stamp;
+		return;
+	}
+	
+	if(priority < out.priority)
+	{
+		mLowerPriority++;
+		StoreFrame(*slot, data, length);
+		return;
+	}
+	
+	if(mMode == MERGE_LTP)
+	{
+		// The channels that this source changed are output
+		for(int i = 0; i < length; i++)
+		{
+			if(i >= slot->length || data[i] != slot->data[i])
+				out.merged[i] = data[i];
+		}
+		if(length > out.length)
+			out.length = length;
+	}
+	StoreFrame(*slot, data, length);
+	if(mMode == MERGE_HTP)
+		Merge(out);
+	out.dirty = true;
+	out.stamp = stamp;
+}
+
+void MergeEngine::StoreFrame(Source &source, const uint8_t *data, int length)
+{
+	memcpy(source.data, data, length);
+	// Channels that are not sent anymore are 0
+	if(source.length > length)
+		memset(source.data + length, 0, source.length - length);
+	source.length = length;
+}
+
+void MergeEngine::RemoveSource(int output, uint64_t source)
+{
+	assert(output >= 0 && output < (int)mOutputs.size());
+	Output &out = mOutputs[output];
+	for(int i = 0; i < MERGE_MAXSOURCES; i++)
+	{
+		if(out.sources[i].time != 0 && out.sources[i].id == source)
+		{
+			out.sources[i].time = 0;
+			// The last frame is held when the last source is removed
+			if(UpdatePriority(out) && out.count > 0)
+			{
+				Merge(out);
+				out.dirty = true;
+			}
+		}
+	}
+}
+
+void MergeEngine::ExpireSources(Output &output, int index, uint64_t now)
+{
+	bool expired = false;
+	for(int i = 0; i < MERGE_MAXSOURCES; i++)
+	{
+		Source &source = output.sources[i];
+		if(source.time != 0 && now - source.time >= mTimeout)
+		{
+			source.time = 0;
+			expired = true;
+		}
+	}
+	if(expired && UpdatePriority(output))
+	{
+		Inform("A source of output %d timed out, %d sources left", index, output.count);
+		// The last frame is held when the last source is removed
+		if(output.count == 0)
+			return;
+		Merge(output);
+		output.dirty = true;
+	}
+}
+
+bool MergeEngine::UpdatePriority(Output &output)
+{
+	int priority = -1;
+	int count = 0;
+	for(int i = 0; i < MERGE_MAXSOURCES; i++)
+	{
+		Source &source = output.sources[i];
+		if(source.time == 0)
+			continue;
+		if(source.priority > priority)
+		{
+			priority = source.priority;
+			count = 1;
+		} else if(source.priority == priority) {
+			count++;
+		}
+	}
+	bool changed = priority != output.priority || count != output.count;
+	output.priority = priority;
+	output.count = count;
+	return changed;
+}
+
+void MergeEngine::Merge(Output &output)
+{
+	// LTP starts from the newest frame, the next frames update the channels they change
+	Source *newest = NULL;
+	for(int i = 0; i < MERGE_MAXSOURCES; i++)
+	{
+		Source &source = output.sources[i];
+		if(source.time == 0 || source.priority != output.priority)
+			continue;
+		if(newest == NULL)
+		{
+			memcpy(output.merged, source.data, MERGE_MAXCHANNELS);
+			output.length = source.length;
+			newest = &source;
+			continue;
+		}
+		if(mMode == MERGE_HTP)
+		{
+			MergeHtp(output.merged, source.data, MERGE_MAXCHANNELS);
+			mMerged++;
+			if(source.length > output.length)
+				output.length = source.length;
+		} else if(source.time > newest->time) {
+			memcpy(output.merged, source.data, MERGE_MAXCHANNELS);
+			output.length = source.length;
+			newest = &source;
+		}
+	}
+}
+
+void MergeEngine::Flush()
+{
+	uint64_t now = 0;
+	for(size_t i = 0; i < mOutputs.size(); i++)
+	{
+		Output &output = mOutputs[i];
+		if(!output.dirty)
+			continue;
+		output.dirty = false;
+		if(output.length == 0)
+			continue;
+		mIpc->SendChannels(i, 1, output.length, output.merged, output.stamp);
+		Metrics::Add(METRIC_FRAMES_SENT);
+		if(output.stamp != 0)
+		{
+			// The outputs of a batch are sent at the same time
+			if(now == 0)
+				now = GetRealTime();
+			mSendLatency.AddSince(output.stamp, now);
+		}
+	}
+}
+
+uint64_t MergeEngine::GetNextTimeout() const
+{
+	uint64_t next = 0;
+	for(size_t i = 0; i < mOutputs.size(); i++)
+	{
+		for(int j = 0; j < MERGE_MAXSOURCES; j++)
+		{
+			const Source &source = mOutputs[i].sources[j];
+			if(source.time == 0)
+				continue;
+			uint64_t timeout = source.time + mTimeout;
+			if(next == 0 || timeout < next)
+				next = timeout;
+		}
+	}
+	return next;
+}
+
+void MergeEngine::HandleTimeouts(uint64_t now)
+{
+	for(size_t i = 0; i < mOutputs.size(); i++)
+	{
+		ExpireSources(mOutputs[i], i, now);
+	}
+	Flush();
+}
+
+void MergeEngine::ReportStatistics()
+{
+	mSendLatency.Report("Receive to IPC latency");
+	if(mLowerPriority == mReportedLowerPriority && mMerged == mReportedMerged)
+		return;
+	Inform("Merge: %llu frames merged, %llu frames of sources with a lower priority ignored",
+		(unsigned long long)(mMerged - mReportedMerged),
+		(unsigned long long)(mLowerPriority - mReportedLowerPriority));
+	mReportedMerged = mMerged;
+	mReportedLowerPriority = mLowerPriority;
+}
@@ -0,0 +1,125 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _MERGEENGINE_H_
+#define _MERGEENGINE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ipc.h"
+#include "latencyhistogram.h"
+
+#define MERGE_MAXCHANNELS 512
+// Number of sources that are tracked for every output
+#define MERGE_MAXSOURCES 8
+// Priority of sources that do not have a priority, the default sACN priority
+#define MERGE_DEFAULTPRIORITY 100
+
+enum MergeMode_t {
+	// Highest takes precedence, every channel is the highest value of the sources
+	MERGE_HTP,
+	// Latest takes precedence, every channel is the value that changed last
+	MERGE_LTP,
+};
+
+// Returns the merge mode with the given name(htp, ltp)
+MergeMode_t ParseMergeMode(const std::string &str);
+
+// HTP merge of two frames, out[i] = max(out[i], in[i])
+void MergeHtp(uint8_t *out, const uint8_t *in, int size);
+
+// Merges the frames of the sources of every output and sends the result to
+// the dmx process. Only the sources with the highest priority are merged,
+// sources with a lower priority take over when the higher sources stop.
+// The receivers store every frame with SetFrame and call Flush after a batch
+// of packets, so every output is sent at most once per batch.
+class MergeEngine
+{
+public:
+	// timeout is the time in ns after which a source that stopped sending is removed
+	MergeEngine(IPC *ipc, int outputs, MergeMode_t mode, uint64_t timeout);
+	
+	// Store the frame of a source for an output
+	// source identifies the sender, priority is 0 to 200
+	// stamp is the receive time on the realtime clock, it is sent along for latency tracing
+	void SetFrame(int output, uint64_t source, int priority, const uint8_t *data, int length,
+		uint64_t now, uint64_t stamp);
+	// Remove a source that stopped sending
+	void RemoveSource(int output, uint64_t source);
+	// Send the merged frames of the outputs that changed
+	void Flush();
+	// Returns the time on the monotonic clock in ns at which the first source
+	// times out, 0 without sources
+	uint64_t GetNextTimeout() const;
+	// Remove the sources that timed out and send the outputs that changed
+	void HandleTimeouts(uint64_t now);
+	// Log the statistics of the merge engine
+	void ReportStatistics();
+	
+private:
+	struct Source {
+		uint64_t id;
+		int priority;
+		// Time of the last frame, 0 when the slot is free
+		uint64_t time;
+		int length;
+		uint8_t data[MERGE_MAXCHANNELS];
+	};
+	struct Output {
+		Source sources[MERGE_MAXSOURCES];
+		// Highest priority of the active sources, -1 without sources
+		int priority;
+		// Number of active sources with the highest priority
+		int count;
+		// Merged frame
+		uint8_t merged[MERGE_MAXCHANNELS];
+		int length;
+		bool dirty;
+		// Receive time of the newest frame that changed the output
+		uint64_t stamp;
+	};
+	
+	// Copy a frame to the buffer of a source
+	void StoreFrame(Source &source, const uint8_t *data, int length);
+	// Remove the sources of an output that timed out
+	void ExpireSources(Output &output, int index, uint64_t now);
+	// Determine the highest priority and the number of sources that have it
+	// Returns true when the sources that are merged changed
+	bool UpdatePriority(Output &output);
+	// Merge the frames of the sources with the highest priority
+	void Merge(Output &output);
+	
+	IPC *mIpc;
+	MergeMode_t mMode;
+	uint64_t mTimeout;
+	std::vector<Output> mOutputs;
+	// Number of frames of sources with a lower priority
+	uint64_t mLowerPriority;
+	uint64_t mReportedLowerPriority;
+	// Number of frames that were merged with other sources
+	uint64_t mMerged;
+	uint64_t mReportedMerged;
+	// Time from receiving a frame to sending it to the dmx process
+	LatencyHistogram mSendLatency;
+};
+
+#endif
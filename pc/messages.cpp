@@ -47,13 +47,15 @@ IPCMessage *GetChannelsResponse(int count, uint8_t *values)
 	return new IPCMessage(MSG_GETCHANNELSRESPONSE, count, values);
 }
 
-IPCMessage *SetChannelsMessage(int address, int count, const uint8_t *values)
+IPCMessage *SetChannelsMessage(int output, int address, int count, const uint8_t *values,
+	uint64_t stamp)
 {
-	uint8_t *buffer = new uint8_t[count+4];
-	DataHelper::SetInt32(buffer, address);
-	memcpy(buffer+4, values, count);
-	IPCMessage *message = new IPCMessage(MSG_SETCHANNELS, count+4, buffer);
-	delete[] buffer;
+	IPCMessage *message = new IPCMessage(MSG_SETCHANNELS, count + SETCHANNELS_HEADERSIZE);
+	uint8_t *buffer = (uint8_t *)message->GetBuffer();
+	DataHelper::SetInt32(buffer, output);
+	DataHelper::SetInt32(buffer+4, address);
+	DataHelper::SetUint64(buffer+8, stamp);
+	memcpy(buffer + SETCHANNELS_HEADERSIZE, values, count);
 	return message;
 }
 
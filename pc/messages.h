@@ -24,11 +24,16 @@ THE SOFTWARE.*/
 
 #include "ipc.h"
 
+// The values of MSG_SETCHANNELS are preceded by the output, the address and
+// the receive time stamp of the frame
+#define SETCHANNELS_HEADERSIZE 16
+
 IPCMessage *GetInfoMessage();
 IPCMessage *GetInfoResponse(int channels);
 IPCMessage *GetChannelsMessage();
 IPCMessage *GetChannelsResponse(int count, uint8_t *values);
-IPCMessage *SetChannelsMessage(int address, int count, const uint8_t *values);
+IPCMessage *SetChannelsMessage(int output, int address, int count, const uint8_t *values,
+	uint64_t stamp = 0);
 IPCMessage *SetChannelMessage(int address, uint8_t value);
 IPCMessage *SetAllMessage(uint8_t value);
 
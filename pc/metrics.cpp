@@ -0,0 +1,143 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include "logger.h"
+#include "metrics.h"
+
+enum MetricType_t {
+	METRICTYPE_COUNTER,
+	METRICTYPE_GAUGE,
+	// Counter of nanoseconds that is exposed in seconds
+	METRICTYPE_SECONDS,
+};
+
+struct MetricInfo {
+	Metric_t metric;
+	const char *name;
+	const char *labels;
+	MetricType_t type;
+	const char *help;
+};
+
+// Metrics with the same name must be adjacent, they share the help text
+static const MetricInfo metricInfo[] = {
+	{METRIC_ARTNET_OPDMX, "dmxd_artnet_packets_total", "opcode=\"dmx\"", METRICTYPE_COUNTER,
+		"Art-Net packets received by opcode"},
+	{METRIC_ARTNET_OPPOLL, "dmxd_artnet_packets_total", "opcode=\"poll\"", METRICTYPE_COUNTER, NULL},
+	{METRIC_ARTNET_OPPOLLREPLY, "dmxd_artnet_packets_total", "opcode=\"pollreply\"", METRICTYPE_COUNTER, NULL},
+	{METRIC_ARTNET_OPSYNC, "dmxd_artnet_packets_total", "opcode=\"sync\"", METRICTYPE_COUNTER, NULL},
+	{METRIC_ARTNET_OTHER, "dmxd_artnet_packets_total", "opcode=\"other\"", METRICTYPE_COUNTER, NULL},
+	{METRIC_SACN_DATA, "dmxd_sacn_packets_total", "vector=\"data\"", METRICTYPE_COUNTER,
+		"sACN packets received by vector"},
+	{METRIC_SACN_SYNC, "dmxd_sacn_packets_total", "vector=\"sync\"", METRICTYPE_COUNTER, NULL},
+	{METRIC_FRAMES_SENT, "dmxd_frames_sent_total", NULL, METRICTYPE_COUNTER,
+		"Frames sent from the server to the dmx process"},
+	{METRIC_FRAMES_DROPPED, "dmxd_frames_dropped_total", NULL, METRICTYPE_COUNTER,
+		"Frames dropped because the IPC queue was full or the frame was superseded"},
+	{METRIC_FRAMES_APPLIED, "dmxd_frames_applied_total", NULL, METRICTYPE_COUNTER,
+		"Frames written to the interfaces"},
+	{METRIC_FRAMES_COALESCED, "dmxd_frames_coalesced_total", NULL, METRICTYPE_COUNTER,
+		"Frames merged into a newer frame before they were written"},
+	{(Metric_t)(METRIC_SPI_COMMANDS + 0), "dmxd_spi_commands_total", "command=\"ignore\"", METRICTYPE_COUNTER,
+		"SPI commands sent to the interfaces by command"},
+	{(Metric_t)(METRIC_SPI_COMMANDS + 1), "dmxd_spi_commands_total", "command=\"setchannel\"", METRICTYPE_COUNTER, NULL},
+	{(Metric_t)(METRIC_SPI_COMMANDS + 2), "dmxd_spi_commands_total", "command=\"getchannels\"", METRICTYPE_COUNTER, NULL},
+	{(Metric_t)(METRIC_SPI_COMMANDS + 3), "dmxd_spi_commands_total", "command=\"setchannels\"", METRICTYPE_COUNTER, NULL},
+	{(Metric_t)(METRIC_SPI_COMMANDS + 4), "dmxd_spi_commands_total", "command=\"getinfo\"", METRICTYPE_COUNTER, NULL},
+	{(Metric_t)(METRIC_SPI_BYTES + 0), "dmxd_spi_bytes_total", "command=\"ignore\"", METRICTYPE_COUNTER,
+		"Bytes sent to the interfaces by command"},
+	{(Metric_t)(METRIC_SPI_BYTES + 1), "dmxd_spi_bytes_total", "command=\"setchannel\"", METRICTYPE_COUNTER, NULL},
+	{(Metric_t)(METRIC_SPI_BYTES + 2), "dmxd_spi_bytes_total", "command=\"getchannels\"", METRICTYPE_COUNTER, NULL},
+	{(Metric_t)(METRIC_SPI_BYTES + 3), "dmxd_spi_bytes_total", "command=\"setchannels\"", METRICTYPE_COUNTER, NULL},
+	{(Metric_t)(METRIC_SPI_BYTES + 4), "dmxd_spi_bytes_total", "command=\"getinfo\"", METRICTYPE_COUNTER, NULL},
+	{METRIC_SPI_ERRORS, "dmxd_spi_errors_total", NULL, METRICTYPE_COUNTER,
+		"SPI transfers that failed"},
+	{METRIC_SERVER_IPC_QUEUE, "dmxd_ipc_queue_bytes", "process=\"server\"", METRICTYPE_GAUGE,
+		"Bytes waiting in the IPC queue to the other process"},
+	{METRIC_DMX_IPC_QUEUE, "dmxd_ipc_queue_bytes", "process=\"dmx\"", METRICTYPE_GAUGE, NULL},
+	{METRIC_SERVER_LOOP_ITERATIONS, "dmxd_loop_iterations_total", "process=\"server\"", METRICTYPE_COUNTER,
+		"Wake ups of the event loop"},
+	{METRIC_DMX_LOOP_ITERATIONS, "dmxd_loop_iterations_total", "process=\"dmx\"", METRICTYPE_COUNTER, NULL},
+	{METRIC_SERVER_LOOP_TIME, "dmxd_loop_busy_seconds_total", "process=\"server\"", METRICTYPE_SECONDS,
+		"Time that the event loop spent handling events"},
+	{METRIC_DMX_LOOP_TIME, "dmxd_loop_busy_seconds_total", "process=\"dmx\"", METRICTYPE_SECONDS, NULL},
+};
+
+static_assert(sizeof(metricInfo) / sizeof(metricInfo[0]) == METRIC_COUNT, "Every metric needs a name");
+
+// Values that are used until the shared memory is created
+static std::atomic<uint64_t> localValues[METRIC_COUNT];
+std::atomic<uint64_t> *Metrics::mValues = localValues;
+
+bool Metrics::Create()
+{
+	size_t size = METRIC_COUNT * sizeof(std::atomic<uint64_t>);
+	void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(memory == MAP_FAILED)
+	{
+		Error("Could not create the shared memory of the metrics: %s", strerror(errno));
+		return false;
+	}
+	std::atomic<uint64_t> *values = (std::atomic<uint64_t> *)memory;
+	for(int i = 0; i < METRIC_COUNT; i++)
+	{
+		new(&values[i]) std::atomic<uint64_t>(mValues[i].load());
+	}
+	mValues = values;
+	return true;
+}
+
+std::string Metrics::Format()
+{
+	std::string text;
+	char line[256];
+	const char *types[] = {"counter", "gauge", "counter"};
+	for(int i = 0; i < METRIC_COUNT; i++)
+	{
+		const MetricInfo &info = metricInfo[i];
+		if(info.help != NULL)
+		{
+			snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", info.name, info.help,
+				info.name, types[info.type]);
+			text += line;
+		}
+		uint64_t value = Get(info.metric);
+		const char *open = info.labels != NULL ? "{" : "";
+		const char *labels = info.labels != NULL ? info.labels : "";
+		const char *close = info.labels != NULL ? "}" : "";
+		if(info.type == METRICTYPE_SECONDS)
+		{
+			snprintf(line, sizeof(line), "%s%s%s%s %.9f\n", info.name, open, labels, close,
+				value / 1000000000.0);
+		} else {
+			snprintf(line, sizeof(line), "%s%s%s%s %llu\n", info.name, open, labels, close,
+				(unsigned long long)value);
+		}
+		text += line;
+	}
+	return text;
+}
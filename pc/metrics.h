@@ -0,0 +1,95 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// Number of SPI commands that have their own counters (ignore, set channel,
+// get channels, set channels, get info)
+#define METRIC_SPI_COMMANDCOUNT 5
+
+// Counters and gauges of both processes
+// The names and labels of the metrics are in the table in metrics.cpp
+enum Metric_t {
+	// Server process
+	METRIC_ARTNET_OPDMX,
+	METRIC_ARTNET_OPPOLL,
+	METRIC_ARTNET_OPPOLLREPLY,
+	METRIC_ARTNET_OPSYNC,
+	METRIC_ARTNET_OTHER,
+	METRIC_SACN_DATA,
+	METRIC_SACN_SYNC,
+	METRIC_FRAMES_SENT,
+	METRIC_FRAMES_DROPPED,
+	METRIC_SERVER_IPC_QUEUE,
+	METRIC_SERVER_LOOP_ITERATIONS,
+	METRIC_SERVER_LOOP_TIME,
+	// Dmx process
+	METRIC_FRAMES_APPLIED,
+	METRIC_FRAMES_COALESCED,
+	// The SPI commands are indexed by the command byte
+	METRIC_SPI_COMMANDS,
+	METRIC_SPI_BYTES = METRIC_SPI_COMMANDS + METRIC_SPI_COMMANDCOUNT,
+	METRIC_SPI_ERRORS = METRIC_SPI_BYTES + METRIC_SPI_COMMANDCOUNT,
+	METRIC_DMX_IPC_QUEUE,
+	METRIC_DMX_LOOP_ITERATIONS,
+	METRIC_DMX_LOOP_TIME,
+	METRIC_COUNT,
+	// Metric that is not recorded
+	METRIC_NONE = -1,
+};
+
+// Registry of the metrics of the daemon. The values live in shared memory,
+// so the counters of both processes are served by the server process.
+// Counters are updated with relaxed atomic operations, so they can be used
+// on the hot paths and from any thread without locks.
+class Metrics
+{
+public:
+	// Create the shared memory, this must be done before forking
+	// Without shared memory the metrics are local to the process
+	static bool Create();
+	
+	static void Add(Metric_t metric, uint64_t value = 1)
+	{
+		mValues[metric].fetch_add(value, std::memory_order_relaxed);
+	}
+	static void Set(Metric_t metric, uint64_t value)
+	{
+		mValues[metric].store(value, std::memory_order_relaxed);
+	}
+	static uint64_t Get(Metric_t metric)
+	{
+		return mValues[metric].load(std::memory_order_relaxed);
+	}
+	
+	// Returns all metrics in the Prometheus text exposition format
+	static std::string Format();
+	
+private:
+	static std::atomic<uint64_t> *mValues;
+};
+
+#endif
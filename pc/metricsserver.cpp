@@ -0,0 +1,232 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cassert>
+#include "logger.h"
+#include "metrics.h"
+#include "timehelper.h"
+#include "metricsserver.h"
+
+MetricsServer::MetricsServer(const std::string &endpoint, EventLoop *loop)
+{
+	assert(loop != NULL);
+	mLoop = loop;
+	mSocket = -1;
+	mTimer = -1;
+	
+	if(!endpoint.empty() && endpoint[0] == '/')
+	{
+		// Unix socket
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if(endpoint.size() >= sizeof(address.sun_path))
+		{
+			Error("Metrics socket path %s is too long", endpoint.c_str());
+			return;
+		}
+		strcpy(address.sun_path, endpoint.c_str());
+		mSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		if(mSocket < 0)
+		{
+			Error("Could not create the metrics socket: %s", strerror(errno));
+			return;
+		}
+		// Remove the socket of a previous run
+		unlink(endpoint.c_str());
+		if(bind(mSocket, (sockaddr *)&address, sizeof(address)) < 0)
+		{
+			Error("Could not bind the metrics socket to %s: %s", endpoint.c_str(), strerror(errno));
+			close(mSocket);
+			mSocket = -1;
+			return;
+		}
+		mPath = endpoint;
+	} else {
+		// Port on localhost
+		char *end;
+		long port = strtol(endpoint.c_str(), &end, 10);
+		if(endpoint.empty() || *end != '\0' || port <= 0 || port > 65535)
+		{
+			Error("Invalid metrics endpoint \"%s\"", endpoint.c_str());
+			return;
+		}
+		mSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		if(mSocket < 0)
+		{
+			Error("Could not create the metrics socket: %s", strerror(errno));
+			return;
+		}
+		int reuse = 1;
+		setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if(bind(mSocket, (sockaddr *)&address, sizeof(address)) < 0)
+		{
+			Error("Could not bind the metrics socket to port %ld: %s", port, strerror(errno));
+			close(mSocket);
+			mSocket = -1;
+			return;
+		}
+	}
+	
+	if(listen(mSocket, 8) < 0 || !mLoop->AddFd(mSocket, EPOLLIN, HandleListenEvent, this))
+	{
+		Error("Could not listen on the metrics socket: %s", strerror(errno));
+		close(mSocket);
+		mSocket = -1;
+		return;
+	}
+	mTimer = mLoop->AddOneShotTimer(HandleTimeoutTimer, this);
+	if(mTimer < 0)
+	{
+		mLoop->RemoveFd(mSocket);
+		close(mSocket);
+		mSocket = -1;
+		return;
+	}
+	Inform("Serving the metrics on %s", endpoint.c_str());
+}
+
+MetricsServer::~MetricsServer()
+{
+	while(!mClients.empty())
+	{
+		CloseClient(mClients.back().fd);
+	}
+	if(mTimer >= 0)
+		mLoop->RemoveTimer(mTimer);
+	if(mSocket >= 0)
+	{
+		mLoop->RemoveFd(mSocket);
+		close(mSocket);
+	}
+	if(!mPath.empty())
+		unlink(mPath.c_str());
+}
+
+bool MetricsServer::IsValid() const
+{
+	return mSocket >= 0;
+}
+
+void MetricsServer::HandleListenEvent(int fd, uint32_t events, void *data)
+{
+	MetricsServer *server = (MetricsServer *)data;
+	int client;
+	while((client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		if(server->mClients.size() >= METRICSSERVER_MAXCLIENTS)
+		{
+			close(client);
+			continue;
+		}
+		// The response is sent when the request arrived
+		if(!server->mLoop->AddFd(client, EPOLLIN, HandleClientEvent, server))
+		{
+			close(client);
+			continue;
+		}
+		Client entry;
+		entry.fd = client;
+		entry.deadline = GetMonotonicTime() + METRICSSERVER_CLIENTTIMEOUT * 1000000ULL;
+		server->mClients.push_back(entry);
+	}
+	server->UpdateTimer();
+}
+
+void MetricsServer::HandleClientEvent(int fd, uint32_t events, void *data)
+{
+	MetricsServer *server = (MetricsServer *)data;
+	char request[METRICSSERVER_REQUESTSIZE];
+	// The request is not parsed, every request gets the metrics
+	ssize_t size = recv(fd, request, sizeof(request), 0);
+	if(size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if(size > 0)
+		server->Respond(fd);
+	server->CloseClient(fd);
+	server->UpdateTimer();
+}
+
+void MetricsServer::HandleTimeoutTimer(uint64_t expirations, void *data)
+{
+	MetricsServer *server = (MetricsServer *)data;
+	uint64_t now = GetMonotonicTime();
+	// The clients are in order of their deadline
+	while(!server->mClients.empty() && server->mClients[0].deadline <= now)
+	{
+		server->CloseClient(server->mClients[0].fd);
+	}
+	server->UpdateTimer();
+}
+
+void MetricsServer::UpdateTimer()
+{
+	mLoop->SetTimerDeadline(mTimer, mClients.empty() ? 0 : mClients[0].deadline);
+}
+
+void MetricsServer::Respond(int fd)
+{
+	std::string body = Metrics::Format();
+	char header[128];
+	snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: %zu\r\n\r\n", body.size());
+	std::string response = header + body;
+	// The response fits in the socket buffer, a client that does not read is dropped
+	ssize_t sent = send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+	if(sent < 0)
+	{
+		Warn("Could not send the metrics: %s", strerror(errno));
+	} else if(sent != (ssize_t)response.size()) {
+		Warn("Could only send %zd of %zu bytes of the metrics", sent, response.size());
+	}
+}
+
+void MetricsServer::CloseClient(int fd)
+{
+	for(size_t i = 0; i < mClients.size(); i++)
+	{
+		if(mClients[i].fd == fd)
+		{
+			mClients.erase(mClients.begin() + i);
+			break;
+		}
+	}
+	mLoop->RemoveFd(fd);
+	shutdown(fd, SHUT_WR);
+	close(fd);
+}
@@ -0,0 +1,75 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _METRICSSERVER_H_
+#define _METRICSSERVER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "eventloop.h"
+
+// Size of the buffer for the request of a client
+#define METRICSSERVER_REQUESTSIZE 1024
+// Maximum number of clients that wait for their response, more are refused
+#define METRICSSERVER_MAXCLIENTS 8
+// Time in ms that a client may take to send its request
+#define METRICSSERVER_CLIENTTIMEOUT 5000
+
+// Serves the metrics in the Prometheus text format over HTTP
+// Listens on a port of localhost or on a Unix socket, every connection gets
+// one response with all metrics and is closed. Clients that do not send a
+// request in time are closed, so they can not pin file descriptors.
+class MetricsServer
+{
+public:
+	// endpoint is a port number on localhost or the path of a Unix socket
+	MetricsServer(const std::string &endpoint, EventLoop *loop);
+	~MetricsServer();
+	
+	bool IsValid() const;
+	
+private:
+	static void HandleListenEvent(int fd, uint32_t events, void *data);
+	static void HandleClientEvent(int fd, uint32_t events, void *data);
+	static void HandleTimeoutTimer(uint64_t expirations, void *data);
+	// Send the metrics to a client and close the connection
+	void Respond(int fd);
+	void CloseClient(int fd);
+	// Arm the timer for the client that times out first
+	void UpdateTimer();
+	
+	struct Client {
+		int fd;
+		// Time on the monotonic clock in ns at which the client is closed
+		uint64_t deadline;
+	};
+	
+	EventLoop *mLoop;
+	int mSocket;
+	std::string mPath;
+	// Clients that did not send their request yet
+	std::vector<Client> mClients;
+	// One-shot timer that closes the clients that timed out
+	int mTimer;
+};
+
+#endif
@@ -0,0 +1,458 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+// Microbenchmarks of the functions that every frame passes through
+// Every benchmark is run until it took at least BENCH_MINTIME, the fastest of
+// BENCH_RUNS runs is reported. The results are written as JSON so the
+// results of different builds can be compared.
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include "datahelper.h"
+#include "ipc.h"
+#include "messages.h"
+#include "artnet.h"
+#include "mergeengine.h"
+#include "latencyhistogram.h"
+#include "dmxcontrol.h"
+#include "nulltransport.h"
+#include "timehelper.h"
+
+// Minimum time of a run in ns
+#define BENCH_MINTIME 200000000LL
+#define BENCH_RUNS 3
+// Number of messages that are decoded by one call to IPC::Tick
+#define BENCH_TICKBATCH 64
+
+// Function that is benchmarked, returns the number of operations it did
+typedef int (*BenchFunction_t)(void *data);
+
+struct BenchResult {
+	std::string name;
+	uint64_t operations;
+	double nsPerOperation;
+};
+
+// Prevent the compiler from removing the benchmarked code
+static volatile uint64_t sink;
+
+static int BenchDataHelperGet(void *data)
+{
+	const unsigned char *buffer = (const unsigned char *)data;
+	uint64_t sum = 0;
+	for(int i = 0; i < 64; i++)
+	{
+		sum += DataHelper::GetInt32(buffer + i * 4);
+		sum += DataHelper::GetUint16(buffer + i * 4);
+	}
+	sink += sum;
+	return 128;
+}
+
+static int BenchDataHelperSet(void *data)
+{
+	unsigned char *buffer = (unsigned char *)data;
+	for(int i = 0; i < 64; i++)
+	{
+		DataHelper::SetInt32(buffer + i * 4, i);
+		DataHelper::SetUint16(buffer + i * 4, i);
+	}
+	sink += buffer[0];
+	return 128;
+}
+
+// Pipe with messages of one size for the IPC::Tick benchmark
+struct TickBench {
+	IPC *ipc;
+	int writeFd;
+	std::vector<unsigned char> messages;
+};
+
+static int BenchIpcTick(void *data)
+{
+	TickBench *bench = (TickBench *)data;
+	if(write(bench->writeFd, &bench->messages[0], bench->messages.size()) < 0)
+		return 0;
+	bench->ipc->Tick();
+	int count = 0;
+	const IPCMessage *message;
+	while((message = bench->ipc->GetMessage()) != NULL)
+	{
+		sink += message->GetDataSize();
+		count++;
+	}
+	return count;
+}
+
+struct SendBench {
+	IPC *ipc;
+	int size;
+	uint8_t values[ARTNETMAXCHANNELS];
+};
+
+static int BenchIpcSendMessage(void *data)
+{
+	SendBench *bench = (SendBench *)data;
+	bench->ipc->SendMessage(MSG_SETCHANNELS, bench->size, bench->values);
+	return 1;
+}
+
+static int BenchIpcSendChannels(void *data)
+{
+	SendBench *bench = (SendBench *)data;
+	bench->ipc->SendChannels(0, 1, bench->size, bench->values);
+	return 1;
+}
+
+static int BenchSetChannelsMessage(void *data)
+{
+	const uint8_t *values = (const uint8_t *)data;
+	IPCMessage *message = SetChannelsMessage(0, 1, ARTNETMAXCHANNELS, values);
+	sink += message->GetDataSize();
+	delete message;
+	return 1;
+}
+
+static int BenchSetChannelMessage(void *data)
+{
+	IPCMessage *message = SetChannelMessage(1, 255);
+	sink += message->GetDataSize();
+	delete message;
+	return 1;
+}
+
+static int BenchGetInfoResponse(void *data)
+{
+	IPCMessage *message = GetInfoResponse(64);
+	sink += message->GetDataSize();
+	delete message;
+	return 1;
+}
+
+struct ArtNetBench {
+	ArtNet *artnet;
+	MergeEngine *merge;
+	unsigned char packet[ARTNETDMXHEADERSIZE + ARTNETMAXCHANNELS];
+	unsigned char sequence;
+	struct sockaddr_in sender;
+};
+
+static int BenchOpDmx(void *data)
+{
+	ArtNetBench *bench = (ArtNetBench *)data;
+	bench->sequence = bench->sequence == 255 ? 1 : bench->sequence + 1;
+	bench->packet[12] = bench->sequence;
+	ArtDmxFrame frame;
+	if(bench->artnet->ParseOpDmx((const char *)bench->packet, sizeof(bench->packet), bench->sender, &frame))
+		bench->artnet->HandleOpDmx(frame);
+	bench->merge->Flush();
+	return 1;
+}
+
+struct HistogramBench {
+	LatencyHistogram histogram;
+	uint64_t sample;
+};
+
+static int BenchHistogramAdd(void *data)
+{
+	HistogramBench *bench = (HistogramBench *)data;
+	// Samples from 0 to 4 ms
+	bench->sample = (bench->sample + 7919) & 0x3FFFFF;
+	bench->histogram.Add(bench->sample);
+	return 1;
+}
+
+struct MergeBench {
+	MergeEngine *merge;
+	uint8_t merged[MERGE_MAXCHANNELS];
+	uint8_t frames[2][MERGE_MAXCHANNELS];
+	uint64_t time;
+};
+
+static int BenchMergeHtp(void *data)
+{
+	MergeBench *bench = (MergeBench *)data;
+	MergeHtp(bench->merged, bench->frames[0], MERGE_MAXCHANNELS);
+	sink += bench->merged[0];
+	return 1;
+}
+
+static int BenchMergeSources(void *data)
+{
+	MergeBench *bench = (MergeBench *)data;
+	// Two sources that both send a frame, the output is sent once
+	bench->time++;
+	bench->frames[0][0]++;
+	bench->merge->SetFrame(0, 1, MERGE_DEFAULTPRIORITY, bench->frames[0], MERGE_MAXCHANNELS, bench->time, 0);
+	bench->merge->SetFrame(0, 2, MERGE_DEFAULTPRIORITY, bench->frames[1], MERGE_MAXCHANNELS, bench->time, 0);
+	bench->merge->Flush();
+	return 2;
+}
+
+struct DmxControlBench {
+	DmxControl *control;
+	uint8_t values[NULLTRANSPORT_CHANNELS];
+	int changes;
+	uint32_t random;
+};
+
+static int BenchRefreshChannels(void *data)
+{
+	DmxControlBench *bench = (DmxControlBench *)data;
+	bench->control->RefreshChannels();
+	return 1;
+}
+
+static int BenchSetChannels(void *data)
+{
+	DmxControlBench *bench = (DmxControlBench *)data;
+	for(int i = 0; i < bench->changes; i++)
+	{
+		bench->random = bench->random * 1103515245 + 12345;
+		bench->values[(bench->random >> 16) % NULLTRANSPORT_CHANNELS]++;
+	}
+	bench->control->SetChannels(1, bench->values, NULLTRANSPORT_CHANNELS);
+	return 1;
+}
+
+static BenchResult RunBenchmark(const char *name, BenchFunction_t function, void *data)
+{
+	BenchResult result;
+	result.name = name;
+	result.operations = 0;
+	result.nsPerOperation = 0;
+	for(int run = 0; run < BENCH_RUNS; run++)
+	{
+		uint64_t operations = 0;
+		int64_t start = GetMonotonicTime();
+		int64_t elapsed;
+		do {
+			for(int i = 0; i < 64; i++)
+			{
+				operations += function(data);
+			}
+			elapsed = GetMonotonicTime() - start;
+		} while(elapsed < BENCH_MINTIME);
+		double ns = operations > 0 ? (double)elapsed / operations : 0;
+		if(run == 0 || ns < result.nsPerOperation)
+		{
+			result.nsPerOperation = ns;
+			result.operations = operations;
+		}
+	}
+	fprintf(stderr, "%-36s %12.1f ns/op\n", name, result.nsPerOperation);
+	return result;
+}
+
+static void WriteJson(FILE *file, const std::vector<BenchResult> &results)
+{
+	fprintf(file, "{\n\t\"timestamp\": %lld,\n\t\"benchmarks\": [\n", (long long)time(NULL));
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		fprintf(file, "\t\t{\"name\": \"%s\", \"operations\": %llu, \"ns_per_op\": %.2f}%s\n",
+			results[i].name.c_str(), (unsigned long long)results[i].operations,
+			results[i].nsPerOperation, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *output = NULL;
+	int c;
+	while((c = getopt(argc, argv, "o:h")) != -1)
+	{
+		switch(c)
+		{
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			printf("Usage %s [-o file]\n\n"
+				"\t-o file: File that the JSON results are written to, default is stdout\n", argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	
+	std::vector<BenchResult> results;
+	
+	// DataHelper
+	unsigned char buffer[256 + 4];
+	memset(buffer, 0x5A, sizeof(buffer));
+	results.push_back(RunBenchmark("DataHelper::Get", BenchDataHelperGet, buffer));
+	results.push_back(RunBenchmark("DataHelper::Set", BenchDataHelperSet, buffer));
+	
+	// IPC::Tick decoding batches of messages of different sizes
+	const int sizes[] = {4, 64, 516};
+	for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		int pipes[2];
+		if(pipe(pipes) < 0)
+		{
+			fprintf(stderr, "Could not create pipe: %s\n", strerror(errno));
+			return 1;
+		}
+		fcntl(pipes[1], F_SETPIPE_SZ, 1024*1024);
+		int null = open("/dev/null", O_WRONLY);
+		TickBench bench;
+		bench.ipc = new IPC(pipes[0], null);
+		bench.writeFd = pipes[1];
+		// Different types, so the messages are not coalesced
+		std::vector<unsigned char> data(sizes[s]);
+		for(int i = 0; i < BENCH_TICKBATCH; i++)
+		{
+			unsigned char header[8];
+			DataHelper::SetInt32(header, MSG_SETCHANNEL);
+			DataHelper::SetInt32(header + 4, sizes[s]);
+			bench.messages.insert(bench.messages.end(), header, header + 8);
+			bench.messages.insert(bench.messages.end(), data.begin(), data.end());
+		}
+		char name[64];
+		snprintf(name, sizeof(name), "IPC::Tick/%d", sizes[s]);
+		results.push_back(RunBenchmark(name, BenchIpcTick, &bench));
+		delete bench.ipc;
+		close(pipes[0]);
+		close(pipes[1]);
+		close(null);
+	}
+	
+	// IPC::SendMessage to /dev/null
+	{
+		int null = open("/dev/null", O_RDWR);
+		SendBench bench;
+		bench.ipc = new IPC(null, null);
+		memset(bench.values, 0, sizeof(bench.values));
+		bench.size = 16;
+		results.push_back(RunBenchmark("IPC::SendMessage/16", BenchIpcSendMessage, &bench));
+		bench.size = ARTNETMAXCHANNELS;
+		results.push_back(RunBenchmark("IPC::SendMessage/512", BenchIpcSendMessage, &bench));
+		results.push_back(RunBenchmark("IPC::SendChannels/512", BenchIpcSendChannels, &bench));
+		delete bench.ipc;
+		close(null);
+	}
+	
+	// Message factories
+	uint8_t values[ARTNETMAXCHANNELS];
+	memset(values, 0, sizeof(values));
+	results.push_back(RunBenchmark("SetChannelsMessage/512", BenchSetChannelsMessage, values));
+	results.push_back(RunBenchmark("SetChannelMessage", BenchSetChannelMessage, NULL));
+	results.push_back(RunBenchmark("GetInfoResponse", BenchGetInfoResponse, NULL));
+	
+	// Art-Net OpDmx parsing and forwarding to /dev/null
+	{
+		int null = open("/dev/null", O_RDWR);
+		IPC ipc(null, null);
+		MergeEngine merge(&ipc, 1, MERGE_HTP, 1000000000ULL);
+		ArtNetBench bench;
+		bench.merge = &merge;
+		bench.artnet = new ArtNet("127.0.0.1", &merge);
+		bench.sequence = 0;
+		memset(&bench.sender, 0, sizeof(bench.sender));
+		bench.sender.sin_family = AF_INET;
+		memset(bench.packet, 0, sizeof(bench.packet));
+		memcpy(bench.packet, "Art-Net", 8);
+		DataHelper::SetUint16(bench.packet + 8, 0x5000); // OpDmx
+		bench.packet[11] = ARTNETPROTVER;
+		bench.packet[16] = (ARTNETMAXCHANNELS >> 8) & 0xFF;
+		bench.packet[17] = ARTNETMAXCHANNELS & 0xFF;
+		results.push_back(RunBenchmark("ArtNet::HandleOpDmx/512", BenchOpDmx, &bench));
+		// A universe that is not output is rejected by the routing table
+		bench.packet[14] = 0x55;
+		results.push_back(RunBenchmark("ArtNet::HandleOpDmx/unsubscribed", BenchOpDmx, &bench));
+		delete bench.artnet;
+		close(null);
+	}
+	
+	// Latency tracing of every frame
+	{
+		HistogramBench bench;
+		bench.sample = 0;
+		results.push_back(RunBenchmark("LatencyHistogram::Add", BenchHistogramAdd, &bench));
+	}
+	
+	// Merging the frames of several sources
+	{
+		int null = open("/dev/null", O_RDWR);
+		IPC ipc(null, null);
+		for(int m = 0; m < 2; m++)
+		{
+			MergeEngine merge(&ipc, 1, m == 0 ? MERGE_HTP : MERGE_LTP, 1000000000ULL);
+			MergeBench bench;
+			bench.merge = &merge;
+			bench.time = 1;
+			for(int i = 0; i < MERGE_MAXCHANNELS; i++)
+			{
+				bench.merged[i] = i * 7;
+				bench.frames[0][i] = i * 13;
+				bench.frames[1][i] = 255 - i;
+			}
+			if(m == 0)
+			{
+				results.push_back(RunBenchmark("MergeHtp/512", BenchMergeHtp, &bench));
+				results.push_back(RunBenchmark("MergeEngine::SetFrame/htp", BenchMergeSources, &bench));
+			} else {
+				results.push_back(RunBenchmark("MergeEngine::SetFrame/ltp", BenchMergeSources, &bench));
+			}
+		}
+		close(null);
+	}
+	
+	// DmxControl against a transport that discards the commands
+	{
+		DmxControl control;
+		if(control.Open(new NullTransport()))
+		{
+			DmxControlBench bench;
+			bench.control = &control;
+			memset(bench.values, 0, sizeof(bench.values));
+			bench.random = 1;
+			results.push_back(RunBenchmark("DmxControl::RefreshChannels", BenchRefreshChannels, &bench));
+			bench.changes = 4;
+			results.push_back(RunBenchmark("DmxControl::SetChannels/4", BenchSetChannels, &bench));
+			bench.changes = NULLTRANSPORT_CHANNELS;
+			results.push_back(RunBenchmark("DmxControl::SetChannels/64", BenchSetChannels, &bench));
+		}
+	}
+	
+	FILE *file = stdout;
+	if(output != NULL)
+	{
+		file = fopen(output, "w");
+		if(file == NULL)
+		{
+			fprintf(stderr, "Could not open %s: %s\n", output, strerror(errno));
+			return 1;
+		}
+	}
+	WriteJson(file, results);
+	if(file != stdout)
+		fclose(file);
+	return 0;
+}
@@ -0,0 +1,59 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <string.h>
+#include "nulltransport.h"
+
+NullTransport::NullTransport()
+{
+	mLastCommand = 0;
+}
+
+NullTransport::~NullTransport()
+{
+}
+
+bool NullTransport::Open(int port, int speed)
+{
+	return true;
+}
+
+void NullTransport::Close()
+{
+}
+
+bool NullTransport::Transfer(SpiTransfer *transfers, int count)
+{
+	for(int i = 0; i < count; i++)
+	{
+		uint8_t command = transfers[i].buffer[0];
+		memset(transfers[i].buffer, 0, transfers[i].length);
+		// The reply to a command is received during the next command and
+		// starts with the command, all channels are 0
+		if(mLastCommand != 0x00)
+			transfers[i].buffer[0] = mLastCommand;
+		if(mLastCommand == 0x04 && transfers[i].length >= 2)
+			transfers[i].buffer[1] = NULLTRANSPORT_CHANNELS;
+		mLastCommand = command;
+	}
+	return true;
+}
@@ -0,0 +1,49 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _NULLTRANSPORT_H_
+#define _NULLTRANSPORT_H_
+
+#include <stdint.h>
+#include "spitransport.h"
+
+// Number of channels that the null transport reports
+#define NULLTRANSPORT_CHANNELS 64
+
+// SPI transport that discards all commands
+// It answers the commands like an interface of which all channels are 0, so
+// DmxControl can be used without an interface and without the time the
+// transfers take.
+class NullTransport : public SpiTransport
+{
+public:
+	NullTransport();
+	~NullTransport();
+	
+	bool Open(int port, int speed);
+	void Close();
+	bool Transfer(SpiTransfer *transfers, int count);
+	
+private:
+	uint8_t mLastCommand;
+};
+
+#endif
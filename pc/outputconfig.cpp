@@ -0,0 +1,147 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <stdio.h>
+#include "logger.h"
+#include "settings.h"
+#include "stringhelper.h"
+#include "outputconfig.h"
+
+bool ParseOutputs(const std::string &str, std::vector<OutputConfig> *outputs)
+{
+	size_t start = 0;
+	while(start < str.size())
+	{
+		size_t end = str.find(',', start);
+		if(end == std::string::npos)
+			end = str.size();
+		std::string item = TrimString(str.substr(start, end - start), " \t");
+		start = end + 1;
+		
+		int net, subNet, universe, port;
+		char extra;
+		if(sscanf(item.c_str(), "%d:%d:%d@%d%c", &net, &subNet, &universe, &port, &extra) != 4 ||
+			net < 0 || net > 0x7F || subNet < 0 || subNet > 0x0F ||
+			universe < 0 || universe > 0x0F || port < 0)
+		{
+			Error("Invalid output \"%s\", expected net:subnet:universe@port", item.c_str());
+			return false;
+		}
+		OutputConfig output;
+		output.portAddress = (net << 8) | (subNet << 4) | universe;
+		output.spiPort = port;
+		output.sacnUniverse = 0;
+		for(size_t i = 0; i < outputs->size(); i++)
+		{
+			if((*outputs)[i].portAddress == output.portAddress || (*outputs)[i].spiPort == port)
+			{
+				Error("Output \"%s\" uses the same universe or SPI port as another output", item.c_str());
+				return false;
+			}
+		}
+		if(outputs->size() == MAXOUTPUTS)
+		{
+			Error("Too many outputs, at most %d outputs are supported", MAXOUTPUTS);
+			return false;
+		}
+		outputs->push_back(output);
+	}
+	return !outputs->empty();
+}
+
+bool ParseSacnUniverses(const std::string &str, std::vector<OutputConfig> *outputs)
+{
+	std::string mode = ToLower(TrimString(str, " \t"));
+	for(size_t i = 0; i < outputs->size(); i++)
+	{
+		(*outputs)[i].sacnUniverse = mode == "auto" ? (*outputs)[i].portAddress + 1 : 0;
+	}
+	if(mode == "off" || mode == "auto")
+		return true;
+	
+	size_t start = 0;
+	size_t index = 0;
+	while(start < str.size())
+	{
+		size_t end = str.find(',', start);
+		if(end == std::string::npos)
+			end = str.size();
+		std::string item = TrimString(str.substr(start, end - start), " \t");
+		start = end + 1;
+		
+		int universe;
+		char extra;
+		if(sscanf(item.c_str(), "%d%c", &universe, &extra) != 1 ||
+			universe < SACN_MINUNIVERSE || universe > SACN_MAXUNIVERSE)
+		{
+			Error("Invalid sACN universe \"%s\", expected %d-%d", item.c_str(),
+				SACN_MINUNIVERSE, SACN_MAXUNIVERSE);
+			return false;
+		}
+		if(index == outputs->size())
+		{
+			Error("There are more sACN universes than outputs");
+			return false;
+		}
+		for(size_t i = 0; i < index; i++)
+		{
+			if((*outputs)[i].sacnUniverse == universe)
+			{
+				Error("sACN universe %d is used by more than one output", universe);
+				return false;
+			}
+		}
+		(*outputs)[index++].sacnUniverse = universe;
+	}
+	if(index != outputs->size())
+	{
+		Error("There are fewer sACN universes than outputs");
+		return false;
+	}
+	return true;
+}
+
+std::vector<OutputConfig> GetOutputConfigs()
+{
+	std::vector<OutputConfig> outputs;
+	std::string str = Settings::GetOutputs();
+	if(ToLower(TrimString(str, " \t")) == "single" || !ParseOutputs(str, &outputs))
+	{
+		if(ToLower(TrimString(str, " \t")) != "single")
+			Warn("Using the Art-Net settings and SPIPort for the output");
+		outputs.clear();
+		OutputConfig output;
+		output.portAddress = ((Settings::GetArtNetNet() & 0x7F) << 8) |
+			((Settings::GetArtNetSubNet() & 0x0F) << 4) |
+			(Settings::GetArtNetUniverse() & 0x0F);
+		output.spiPort = Settings::GetSPIPort();
+		output.sacnUniverse = 0;
+		outputs.push_back(output);
+	}
+	
+	if(!ParseSacnUniverses(Settings::GetSacnUniverses(), &outputs))
+	{
+		Warn("sACN is not used");
+		ParseSacnUniverses("off", &outputs);
+	}
+	return outputs;
+}
@@ -0,0 +1,54 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _OUTPUTCONFIG_H_
+#define _OUTPUTCONFIG_H_
+
+#include <string>
+#include <vector>
+
+// Maximum number of outputs
+#define MAXOUTPUTS 16
+// Valid sACN universes
+#define SACN_MINUNIVERSE 1
+#define SACN_MAXUNIVERSE 63999
+
+// Universe that is output and the interface it is output on
+struct OutputConfig {
+	// 15 bit port-address of the universe
+	unsigned short portAddress;
+	// SPI port (chip select) of the interface
+	int spiPort;
+	// sACN universe that is output, 0 when sACN is not used
+	int sacnUniverse;
+};
+
+// Parse a comma separated list of net:subnet:universe@port
+// Returns false when the list contains errors
+bool ParseOutputs(const std::string &str, std::vector<OutputConfig> *outputs);
+// Parse the sACN universes of the outputs, off, auto or a comma separated
+// list with one universe for every output. auto uses the port-address + 1
+// Returns false when the list contains errors
+bool ParseSacnUniverses(const std::string &str, std::vector<OutputConfig> *outputs);
+// Returns the outputs of the Outputs and SacnUniverses settings, there is always at least one
+std::vector<OutputConfig> GetOutputConfigs();
+
+#endif
@@ -0,0 +1,325 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#include <signal.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include "logger.h"
+#include "timehelper.h"
+#include "metrics.h"
+#include "realtimehelper.h"
+#include "outputworker.h"
+
+OutputWorker::OutputWorker(DmxControl *control, int index, int rate)
+{
+	assert(control != NULL);
+	mControl = control;
+	mIndex = index;
+	mChannelCount = control->GetChannelCount();
+	mPeriod = rate > 0 ? 1000000000ULL / rate : 0;
+	mPriority = 0;
+	mCpu = -1;
+	mTestDuration = 0;
+	mStarted = false;
+	mStop = false;
+	sem_init(&mWakeup, 0, 0);
+	mSkippedFrames = 0;
+	mMissedTicks = 0;
+	mReportedMissedTicks = 0;
+	mBusyTime = 0;
+	mReportedBusyTime = 0;
+	mReportTime = GetMonotonicTime();
+	
+	// Start with the values that are read from the interface
+	mImage.resize(mChannelCount);
+	control->GetChannels(1, mImage.data(), mChannelCount);
+	for(int i = 0; i < 3; i++)
+	{
+		mFrames[i].values = mImage;
+		mFrames[i].stamp = 0;
+		mFrames[i].received = 0;
+	}
+	mMailbox = 0;
+	mBack = 1;
+	mFront = 2;
+}
+
+OutputWorker::~OutputWorker()
+{
+	Stop();
+	sem_destroy(&mWakeup);
+	delete mControl;
+}
+
+void OutputWorker::SetRealtime(int priority, int cpu, int testDuration)
+{
+	assert(!mStarted);
+	mPriority = priority;
+	mCpu = cpu;
+	mTestDuration = testDuration;
+}
+
+bool OutputWorker::Start()
+{
+	assert(!mStarted);
+	
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	pthread_attr_setstacksize(&attributes, OUTPUTWORKER_STACKSIZE);
+	
+	// The signals must be handled by the event loop of the main thread
+	sigset_t blocked;
+	sigset_t original;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGTERM);
+	sigaddset(&blocked, SIGCHLD);
+	pthread_sigmask(SIG_BLOCK, &blocked, &original);
+	int result = pthread_create(&mThread, &attributes, Run, this);
+	pthread_sigmask(SIG_SETMASK, &original, NULL);
+	pthread_attr_destroy(&attributes);
+	
+	if(result != 0)
+	{
+		Error("Could not start the worker of output %d: %s", mIndex, strerror(result));
+		return false;
+	}
+	mStarted = true;
+	return true;
+}
+
+void OutputWorker::Stop()
+{
+	if(!mStarted)
+		return;
+	mStop = true;
+	sem_post(&mWakeup);
+	pthread_join(mThread, NULL);
+	mStarted = false;
+}
+
+int OutputWorker::GetChannelCount() const
+{
+	return mChannelCount;
+}
+
+void OutputWorker::Post(uint64_t stamp, uint64_t received)
+{
+	Frame *frame = &mFrames[mBack];
+	memcpy(frame->values.data(), mImage.data(), mChannelCount);
+	frame->stamp = stamp;
+	// Frames that did not come from the server are as old as the update
+	frame->received = received != 0 ? received : GetRealTime();
+	
+	// Swap the frame with the one in the mailbox, that frame is filled next
+	int previous = mMailbox.exchange(mBack | OUTPUTWORKER_NEWFRAME, std::memory_order_acq_rel);
+	if(previous & OUTPUTWORKER_NEWFRAME)
+	{
+		mSkippedFrames.fetch_add(1, std::memory_order_relaxed);
+		Metrics::Add(METRIC_FRAMES_COALESCED);
+	}
+	mBack = previous & ~OUTPUTWORKER_NEWFRAME;
+	
+	// The tick loop does not wait for frames
+	if(mPeriod == 0)
+		sem_post(&mWakeup);
+}
+
+OutputWorker::Frame *OutputWorker::TakeFrame()
+{
+	if(!(mMailbox.load(std::memory_order_acquire) & OUTPUTWORKER_NEWFRAME))
+		return NULL;
+	// Only the worker clears the flag, so the mailbox holds a new frame
+	int previous = mMailbox.exchange(mFront, std::memory_order_acq_rel);
+	mFront = previous & ~OUTPUTWORKER_NEWFRAME;
+	return &mFrames[mFront];
+}
+
+void OutputWorker::Write(const Frame *frame)
+{
+	uint64_t start = GetRealTime();
+	// The control only sends the channels that changed
+	mControl->SetChannels(1, (uint8_t *)frame->values.data(), mChannelCount);
+	uint64_t end = GetRealTime();
+	Metrics::Add(METRIC_FRAMES_APPLIED);
+	mBusyTime.fetch_add(end > start ? end - start : 0, std::memory_order_relaxed);
+	mFrameAge.AddSince(frame->received, start);
+	mWriteLatency.Add(end - start);
+	mTotalLatency.AddSince(frame->stamp, end);
+}
+
+void OutputWorker::SetAll(uint8_t value)
+{
+	if(mChannelCount == 0)
+		return;
+	memset(mImage.data(), value, mChannelCount);
+	Post(0, 0);
+}
+
+void OutputWorker::SetChannel(int address, uint8_t value)
+{
+	SetChannels(address, &value, 1);
+}
+
+int OutputWorker::SetChannels(int address, const uint8_t *values, int size, uint64_t stamp,
+	uint64_t received)
+{
+	if(address < 1 || address > mChannelCount || size <= 0)
+		return 0;
+	if(address - 1 + size > mChannelCount)
+	{
+		size = mChannelCount - address + 1;
+	}
+	memcpy(mImage.data() + address - 1, values, size);
+	Post(stamp, received);
+	return size;
+}
+
+int OutputWorker::GetChannels(int address, uint8_t *values, int size)
+{
+	if(address < 1 || address > mChannelCount)
+		return 0;
+	if(address - 1 + size > mChannelCount)
+	{
+		size = mChannelCount - address + 1;
+	}
+	memcpy(values, mImage.data() + address - 1, size);
+	return size;
+}
+
+uint64_t OutputWorker::GetSkippedFrames()
+{
+	return mSkippedFrames.load(std::memory_order_relaxed);
+}
+
+void OutputWorker::ReportStatistics()
+{
+	char name[64];
+	snprintf(name, sizeof(name), "Output %d frame age", mIndex);
+	mFrameAge.Report(name);
+	snprintf(name, sizeof(name), "Output %d write latency", mIndex);
+	mWriteLatency.Report(name);
+	snprintf(name, sizeof(name), "Output %d receive to write latency", mIndex);
+	mTotalLatency.Report(name);
+	
+	// Fraction of the time that the worker was writing to the interface
+	uint64_t now = GetMonotonicTime();
+	uint64_t busy = mBusyTime.load(std::memory_order_relaxed);
+	if(now > mReportTime)
+	{
+		Inform("Output %d duty cycle: %.1f%%", mIndex,
+			100.0 * (busy - mReportedBusyTime) / (now - mReportTime));
+	}
+	mReportedBusyTime = busy;
+	mReportTime = now;
+	
+	if(mPeriod == 0)
+		return;
+	snprintf(name, sizeof(name), "Output %d tick jitter", mIndex);
+	mJitter.Report(name);
+	uint64_t missedTicks = mMissedTicks.load(std::memory_order_relaxed);
+	uint64_t missed = missedTicks - mReportedMissedTicks;
+	mReportedMissedTicks = missedTicks;
+	if(missed > 0)
+	{
+		Warn("Output %d missed %llu ticks", mIndex, (unsigned long long)missed);
+	}
+}
+
+void *OutputWorker::Run(void *data)
+{
+	OutputWorker *worker = (OutputWorker *)data;
+	worker->SetupThread();
+	if(worker->mPeriod > 0)
+		worker->TickLoop();
+	else
+		worker->Loop();
+	return NULL;
+}
+
+void OutputWorker::SetupThread()
+{
+	PrefaultStack(OUTPUTWORKER_PREFAULTSIZE);
+	if(mCpu >= 0)
+		SetThreadCpu(mCpu);
+	if(mPriority > 0)
+		SetThreadPriority(mPriority);
+	if(mTestDuration <= 0)
+		return;
+	
+	// Frames that are posted during the test wait in the mailbox
+	LatencyHistogram latency;
+	MeasureWakeupLatency(mTestDuration * 1000000ULL, OUTPUTWORKER_TESTPERIOD, &latency);
+	char name[64];
+	snprintf(name, sizeof(name), "Output %d wakeup latency", mIndex);
+	latency.Report(name);
+}
+
+void OutputWorker::Loop()
+{
+	for(;;)
+	{
+		Frame *frame = TakeFrame();
+		if(frame != NULL)
+		{
+			Write(frame);
+			continue;
+		}
+		// The newest frame is written before the worker stops
+		if(mStop)
+			break;
+		// Every post counts, so a frame posted after TakeFrame is not missed
+		while(sem_wait(&mWakeup) < 0 && errno == EINTR);
+	}
+}
+
+void OutputWorker::TickLoop()
+{
+	// The deadlines are absolute, so the time that a write takes does not make the ticks drift
+	uint64_t deadline = GetMonotonicTime() + mPeriod;
+	for(;;)
+	{
+		struct timespec ts = NsToTimespec(deadline);
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+		uint64_t now = GetMonotonicTime();
+		mJitter.Add(now - deadline);
+		
+		bool stop = mStop;
+		// Ticks without a new frame do not write, the interface keeps its values
+		Frame *frame = TakeFrame();
+		if(frame != NULL)
+			Write(frame);
+		// The newest frame is written before the worker stops
+		else if(stop)
+			break;
+		
+		deadline += mPeriod;
+		now = GetMonotonicTime();
+		if(now >= deadline)
+		{
+			// Skip the ticks that passed during the write instead of writing them in a burst
+			uint64_t missed = (now - deadline) / mPeriod + 1;
+			deadline += missed * mPeriod;
+			mMissedTicks.fetch_add(missed, std::memory_order_relaxed);
+		}
+	}
+}
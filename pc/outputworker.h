@@ -0,0 +1,152 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _OUTPUTWORKER_H_
+#define _OUTPUTWORKER_H_
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "dmxcontrol.h"
+#include "latencyhistogram.h"
+
+// Flag in the mailbox that is set when the frame was not taken yet
+#define OUTPUTWORKER_NEWFRAME 4
+// Stack of the worker thread, small so locking the memory does not lock megabytes
+#define OUTPUTWORKER_STACKSIZE (256 * 1024)
+// Part of the stack that is faulted in when the thread starts
+#define OUTPUTWORKER_PREFAULTSIZE (64 * 1024)
+// Period of the deadlines of the wakeup latency test in ns
+#define OUTPUTWORKER_TESTPERIOD 1000000ULL
+
+// Thread that writes the channels of one output to its interface, so a
+// slow interface does not hold up the other outputs or the message handling.
+// The message loop keeps the image of the channels and posts a copy to a
+// single-slot mailbox after every update. The worker always takes the newest
+// frame, frames that were replaced before the worker took them are skipped.
+// The mailbox is a lock-free triple buffer, posting never blocks.
+// With a rate the worker writes on fixed deadline ticks instead, every tick
+// writes the newest frame so the fixtures see regular frames.
+class OutputWorker
+{
+public:
+	// The worker takes ownership of the opened control
+	// rate is the number of ticks per second, 0 writes every update as soon as possible
+	OutputWorker(DmxControl *control, int index, int rate = 0);
+	~OutputWorker();
+	
+	// Run the thread with real-time scheduling, must be called before Start
+	// priority is the SCHED_FIFO priority or 0, cpu is the core that the thread is
+	// pinned to or -1, and the wakeup latency is measured for testDuration ms when
+	// the thread starts
+	void SetRealtime(int priority, int cpu, int testDuration);
+	// Start the thread
+	bool Start();
+	// Wait until the newest frame is written and stop the thread
+	void Stop();
+	
+	// The functions below must be called from one thread
+	int GetChannelCount() const;
+	void SetAll(uint8_t value);
+	void SetChannel(int address, uint8_t value);
+	// stamp is the time the frame was received by the server and received the time it
+	// arrived in this process, both on the realtime clock and 0 when unknown
+	int SetChannels(int address, const uint8_t *values, int size, uint64_t stamp = 0,
+		uint64_t received = 0);
+	// Get the channels that were last set, they might not be written yet
+	int GetChannels(int address, uint8_t *values, int size);
+	// Number of frames that were replaced by a newer frame before they were written
+	uint64_t GetSkippedFrames();
+	// Log the latency of the writes, the age of the written frames, the duty cycle
+	// of the worker and the jitter of the ticks and the missed ticks
+	void ReportStatistics();
+	
+private:
+	struct Frame {
+		std::vector<uint8_t> values;
+		// Times of the update on the realtime clock, stamp is 0 when unknown
+		uint64_t stamp;
+		uint64_t received;
+	};
+	
+	static void *Run(void *data);
+	// Apply the real-time settings to the worker thread and run the wakeup test
+	void SetupThread();
+	void Loop();
+	// Write the newest frame at every deadline
+	void TickLoop();
+	// Copy the image to a frame and post it in the mailbox
+	void Post(uint64_t stamp, uint64_t received);
+	// Take the newest frame from the mailbox, returns NULL when there is no new frame
+	Frame *TakeFrame();
+	// Write the channels to the interface and trace the latency
+	void Write(const Frame *frame);
+	
+	DmxControl *mControl;
+	int mIndex;
+	int mChannelCount;
+	// Time between two ticks in ns, 0 without ticks
+	uint64_t mPeriod;
+	
+	int mPriority;
+	int mCpu;
+	int mTestDuration;
+	
+	pthread_t mThread;
+	bool mStarted;
+	std::atomic<bool> mStop;
+	// Posted after every frame when the worker waits for frames
+	sem_t mWakeup;
+	
+	// Channels that were last set, only used by the posting thread
+	std::vector<uint8_t> mImage;
+	// The frame in the mailbox, possibly with OUTPUTWORKER_NEWFRAME
+	std::atomic<int> mMailbox;
+	Frame mFrames[3];
+	// Frame that the posting thread fills next
+	int mBack;
+	// Frame that the worker writes
+	int mFront;
+	std::atomic<uint64_t> mSkippedFrames;
+	
+	// Statistics, the histograms are lock free
+	// Time between the deadline and the moment the worker woke up
+	LatencyHistogram mJitter;
+	// Ticks that were missed because a write took longer than a period
+	std::atomic<uint64_t> mMissedTicks;
+	uint64_t mReportedMissedTicks;
+	// Time that the worker spent writing in ns
+	std::atomic<uint64_t> mBusyTime;
+	uint64_t mReportedBusyTime;
+	uint64_t mReportTime;
+	
+	// Latency tracing
+	// Time from arriving in this process to the start of the write
+	LatencyHistogram mFrameAge;
+	// Time that the write to the interface takes
+	LatencyHistogram mWriteLatency;
+	// Time from receiving the frame in the server to the end of the write
+	LatencyHistogram mTotalLatency;
+};
+
+#endif
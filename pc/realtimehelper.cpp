@@ -0,0 +1,131 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#include <pthread.h>
+#include <sched.h>
+#include <alloca.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <cerrno>
+#include <cstring>
+#include "logger.h"
+#include "timehelper.h"
+#include "realtimehelper.h"
+
+bool RaiseRealtimeLimits(int priority, bool lockMemory)
+{
+	bool result = true;
+	if(priority > 0)
+	{
+		struct rlimit limit;
+		limit.rlim_cur = priority;
+		limit.rlim_max = priority;
+		if(setrlimit(RLIMIT_RTPRIO, &limit) < 0)
+		{
+			Warn("Could not raise the real-time priority limit: %s", strerror(errno));
+			result = false;
+		}
+	}
+	if(lockMemory)
+	{
+		struct rlimit limit;
+		limit.rlim_cur = RLIM_INFINITY;
+		limit.rlim_max = RLIM_INFINITY;
+		if(setrlimit(RLIMIT_MEMLOCK, &limit) < 0)
+		{
+			Warn("Could not raise the locked memory limit: %s", strerror(errno));
+			result = false;
+		}
+	}
+	return result;
+}
+
+bool SetThreadPriority(int priority)
+{
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if(result != 0)
+	{
+		Warn("Could not set the real-time priority %d: %s", priority, strerror(result));
+		return false;
+	}
+	return true;
+}
+
+bool SetThreadCpu(int cpu)
+{
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	if(result != 0)
+	{
+		Warn("Could not pin the thread to cpu %d: %s", cpu, strerror(result));
+		return false;
+	}
+	return true;
+}
+
+bool LockMemory()
+{
+	// Keep freed memory in the heap instead of returning it to the kernel, and
+	// allocate large blocks from the heap too, so new allocations reuse locked pages
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	if(mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+	{
+		Warn("Could not lock the memory: %s", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+void PrefaultStack(size_t size)
+{
+	volatile char *stack = (volatile char *)alloca(size);
+	size_t page = sysconf(_SC_PAGESIZE);
+	// One write per page is enough
+	for(size_t i = 0; i < size; i += page)
+	{
+		stack[i] = 0;
+	}
+}
+
+void MeasureWakeupLatency(uint64_t duration, uint64_t period, LatencyHistogram *latency)
+{
+	uint64_t deadline = GetMonotonicTime() + period;
+	uint64_t end = deadline + duration;
+	while(deadline < end)
+	{
+		struct timespec ts = NsToTimespec(deadline);
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+		uint64_t now = GetMonotonicTime();
+		latency->Add(now - deadline);
+		deadline += period;
+		// Do not count the deadlines that passed while reporting a late wakeup
+		if(now >= deadline)
+			deadline = now + period;
+	}
+}
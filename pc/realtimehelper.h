@@ -0,0 +1,47 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _REALTIMEHELPER_H_
+#define _REALTIMEHELPER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "latencyhistogram.h"
+
+// Raise the resource limits so the process can still use real-time scheduling
+// and lock its memory after it dropped its root privileges
+// priority is the highest SCHED_FIFO priority that will be used
+bool RaiseRealtimeLimits(int priority, bool lockMemory);
+// Schedule the calling thread with SCHED_FIFO at the given priority
+bool SetThreadPriority(int priority);
+// Run the calling thread only on the given cpu core
+bool SetThreadCpu(int cpu);
+// Lock all current and future pages of the process in memory, the current pages
+// are faulted in. Freed memory is kept by malloc so it stays locked.
+bool LockMemory();
+// Touch size bytes of the stack of the calling thread, so the pages are mapped
+// before the thread needs them
+void PrefaultStack(size_t size);
+// Sleep to absolute deadlines every period ns for duration ns and add the time
+// between every deadline and the wakeup to latency
+void MeasureWakeupLatency(uint64_t duration, uint64_t period, LatencyHistogram *latency);
+
+#endif
@@ -0,0 +1,44 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <cassert>
+#include "routingtable.h"
+
+RoutingTable::RoutingTable(int size)
+{
+	assert(size > 0);
+	mOutputs.assign(size, ROUTINGTABLE_NONE);
+}
+
+bool RoutingTable::Add(int address, int output)
+{
+	assert(output >= 0 && output < ROUTINGTABLE_NONE);
+	if(address < 0 || address >= (int)mOutputs.size() || mOutputs[address] != ROUTINGTABLE_NONE)
+		return false;
+	mOutputs[address] = output;
+	return true;
+}
+
+void RoutingTable::Clear()
+{
+	mOutputs.assign(mOutputs.size(), ROUTINGTABLE_NONE);
+}
@@ -0,0 +1,60 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _ROUTINGTABLE_H_
+#define _ROUTINGTABLE_H_
+
+#include <stdint.h>
+#include <vector>
+
+// Number of 15 bit Art-Net port-addresses
+#define ROUTINGTABLE_PORTADDRESSES 32768
+// Marks addresses that are not routed to an output
+#define ROUTINGTABLE_NONE 0xFF
+
+// Maps universe addresses to output indices with one table entry for every
+// address, so a lookup is a single load and unsubscribed universes are
+// rejected without searching the outputs.
+class RoutingTable
+{
+public:
+	// Create an empty table for the addresses 0 to size - 1
+	RoutingTable(int size = ROUTINGTABLE_PORTADDRESSES);
+	
+	// Route address to output, returns false when the address is out of
+	// range or already routed
+	bool Add(int address, int output);
+	void Clear();
+	
+	// Returns the output of address or -1 when it is not routed
+	inline int Lookup(int address) const
+	{
+		if((unsigned int)address >= mOutputs.size())
+			return -1;
+		uint8_t output = mOutputs[address];
+		return output == ROUTINGTABLE_NONE ? -1 : output;
+	}
+	
+private:
+	std::vector<uint8_t> mOutputs;
+};
+
+#endif
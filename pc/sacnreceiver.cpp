@@ -0,0 +1,450 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <cassert>
+#include <cerrno>
+#include "datahelper.h"
+#include "logger.h"
+#include "outputconfig.h"
+#include "timehelper.h"
+#include "metrics.h"
+#include "sacnreceiver.h"
+
+// Vectors of the E1.31 layers
+#define VECTOR_ROOT_E131_DATA 0x00000004
+#define VECTOR_ROOT_E131_EXTENDED 0x00000008
+#define VECTOR_E131_DATA_PACKET 0x00000002
+#define VECTOR_E131_EXTENDED_SYNCHRONIZATION 0x00000001
+#define VECTOR_DMP_SET_PROPERTY 0x02
+
+// Options of the framing layer
+#define SACNOPTION_PREVIEW 0x80
+#define SACNOPTION_TERMINATED 0x40
+
+static const unsigned char AcnPacketIdentifier[12] = {
+	'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0
+};
+
+SacnReceiver::SacnReceiver(std::string ip, MergeEngine *merge) :
+	mRoutes(SACN_MAXUNIVERSE + 1),
+	mSequences(MAXOUTPUTS, SACNSOURCETIMEOUT * 1000000ULL, SEQUENCE_SACN)
+{
+	assert(merge != NULL);
+	mMerge = merge;
+	mBuffer = NULL;
+	std::vector<OutputConfig> outputs = GetOutputConfigs();
+	mOutputs.resize(outputs.size());
+	for(size_t i = 0; i < outputs.size(); i++)
+	{
+		Output &output = mOutputs[i];
+		output.universe = outputs[i].sacnUniverse;
+		if(output.universe != 0)
+			mRoutes.Add(output.universe, i);
+		output.stagedCount = 0;
+	}
+	
+	// Get the interface that joins the multicast groups
+	if(inet_aton(ip.c_str(), &mInterface) == 0)
+	{
+		Warn("sACN: Invalid ip address %s, using the default interface", ip.c_str());
+		mInterface.s_addr = htonl(INADDR_ANY);
+	}
+	
+	// Create the socket
+	mSocket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if(mSocket < 0)
+	{
+		Error("sACN: Could not create socket: %s", strerror(errno));
+		return;
+	}
+	
+	// Set socket options
+	int reuse = 1;
+	setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	// Room for bursts of many universes
+	int receiveBuffer = SACNRECEIVEBUFFER;
+	setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+	// Stamp the datagrams when they are received, to trace the latency of the frames
+	int timestamp = 1;
+	setsockopt(mSocket, SOL_SOCKET, SO_TIMESTAMPNS, &timestamp, sizeof(timestamp));
+	// Only receive the groups that this socket joined, not the groups of
+	// other sockets on the host
+	int multicastAll = 0;
+	setsockopt(mSocket, IPPROTO_IP, IP_MULTICAST_ALL, &multicastAll, sizeof(multicastAll));
+	
+	// Bind to all interfaces to receive multicast and unicast data
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(SACNPORT);
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	if(bind(mSocket, (sockaddr *)&address, sizeof(address)) < 0)
+	{
+		Error("sACN: Could not bind the socket: %s", strerror(errno));
+		close(mSocket);
+		mSocket = -1;
+		return;
+	}
+	
+	for(size_t i = 0; i < mOutputs.size(); i++)
+	{
+		if(mOutputs[i].universe == 0)
+			continue;
+		if(!JoinUniverse(mOutputs[i].universe))
+		{
+			close(mSocket);
+			mSocket = -1;
+			return;
+		}
+		Inform("sACN: Listening on universe %d", mOutputs[i].universe);
+	}
+	
+	// Creating the receive slots
+	mBuffer = new char[SACNBATCHSIZE * SACNBUFFERSIZE];
+	memset(mMessages, 0, sizeof(mMessages));
+	for(int i = 0; i < SACNBATCHSIZE; i++)
+	{
+		mIovecs[i].iov_base = mBuffer + i * SACNBUFFERSIZE;
+		mIovecs[i].iov_len = SACNBUFFERSIZE;
+		mMessages[i].msg_hdr.msg_iov = &mIovecs[i];
+		mMessages[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+SacnReceiver::~SacnReceiver()
+{
+	if(mBuffer)
+		delete[] mBuffer;
+	if(mSocket >= 0)
+	{
+		close(mSocket);
+	}
+}
+
+bool SacnReceiver::IsValid() const
+{
+	return mSocket >= 0;
+}
+
+int SacnReceiver::GetSocket() const
+{
+	return mSocket;
+}
+
+bool SacnReceiver::JoinUniverse(unsigned short universe)
+{
+	struct ip_mreq request;
+	request.imr_multiaddr.s_addr = GetSacnMulticastAddress(universe);
+	request.imr_interface = mInterface;
+	if(setsockopt(mSocket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) < 0)
+	{
+		Error("sACN: Could not join the multicast group of universe %d: %s", universe, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+void SacnReceiver::Tick()
+{
+	assert(IsValid());
+	
+	int count;
+	do {
+		for(int i = 0; i < SACNBATCHSIZE; i++)
+		{
+			mMessages[i].msg_hdr.msg_control = mControls[i];
+			mMessages[i].msg_hdr.msg_controllen = sizeof(mControls[i]);
+		}
+		count = recvmmsg(mSocket, mMessages, SACNBATCHSIZE, MSG_DONTWAIT, NULL);
+		if(count < 0)
+		{
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				Error("sACN: Error while reading socket: %s", strerror(errno));
+			}
+			break;
+		}
+		HandleBatch(count);
+		// A full batch means that there can be more datagrams waiting
+	} while(count == SACNBATCHSIZE);
+}
+
+uint64_t SacnReceiver::GetNextTimeout() const
+{
+	uint64_t next = 0;
+	for(size_t i = 0; i < mSyncUniverses.size(); i++)
+	{
+		const SyncUniverse &sync = mSyncUniverses[i];
+		if(sync.time == 0)
+			continue;
+		uint64_t timeout = sync.time + SACNSYNCTIMEOUT * 1000000ULL;
+		if(next == 0 || timeout < next)
+			next = timeout;
+	}
+	return next;
+}
+
+void SacnReceiver::HandleTimeouts()
+{
+	CheckSyncTimeouts();
+}
+
+void SacnReceiver::ReportStatistics()
+{
+	mSequences.Report("sACN sequence numbers");
+}
+
+void SacnReceiver::HandleBatch(int count)
+{
+	CheckSyncTimeouts();
+	for(int i = 0; i < count; i++)
+	{
+		const char *buffer = (const char *)mIovecs[i].iov_base;
+		const unsigned char *data = (const unsigned char *)buffer;
+		int len = mMessages[i].msg_len;
+		if((mMessages[i].msg_hdr.msg_flags & MSG_TRUNC) || len < SACNROOTHEADERSIZE ||
+			DataHelper::GetUint16BE(data) != 0x0010 ||
+			memcmp(data + 4, AcnPacketIdentifier, sizeof(AcnPacketIdentifier)) != 0)
+			continue;
+		
+		switch(DataHelper::GetUint32BE(data + 18))
+		{
+			case VECTOR_ROOT_E131_DATA:
+			{
+				Metrics::Add(METRIC_SACN_DATA);
+				SacnFrame frame;
+				if(!ParseData(buffer, len, &frame))
+					break;
+				frame.stamp = GetReceiveTime(mMessages[i].msg_hdr);
+				if(frame.syncAddress != 0 && IsSyncActive(frame.syncAddress, GetMonotonicTime()))
+				{
+					StageFrame(frame);
+					break;
+				}
+				HandleData(frame);
+				break;
+			}
+			case VECTOR_ROOT_E131_EXTENDED:
+				Metrics::Add(METRIC_SACN_SYNC);
+				// Frames that were received before the synchronization packet are output first
+				mMerge->Flush();
+				HandleSync(buffer, len);
+				break;
+		}
+	}
+	
+	// Every output is sent once with the merge of the newest frames of its sources
+	mMerge->Flush();
+}
+
+bool SacnReceiver::ParseData(const char *buffer, int len, SacnFrame *frame)
+{
+	if(len < SACNDATAHEADERSIZE)
+		return false;
+	const unsigned char *data = (const unsigned char *)buffer;
+	unsigned short universe = DataHelper::GetUint16BE(data + 113);
+	
+	// Only handle the universes of our outputs, unicast packets can contain any universe
+	int index = mRoutes.Lookup(universe);
+	if(index < 0)
+		return false;
+	
+	if(DataHelper::GetUint32BE(data + 40) != VECTOR_E131_DATA_PACKET ||
+		DataHelper::GetUint8(data + 117) != VECTOR_DMP_SET_PROPERTY ||
+		DataHelper::GetUint8(data + 118) != 0xA1 ||
+		DataHelper::GetUint16BE(data + 119) != 0x0000 ||
+		DataHelper::GetUint16BE(data + 121) != 0x0001)
+		return false;
+	
+	// The CID identifies the source, it is folded to 64 bits
+	uint64_t cid = 0;
+	for(int i = 0; i < 16; i++)
+	{
+		cid ^= (uint64_t)data[22 + i] << ((i % 8) * 8);
+	}
+	unsigned char priority = DataHelper::GetUint8(data + 108);
+	unsigned short syncAddress = DataHelper::GetUint16BE(data + 109);
+	unsigned char sequence = DataHelper::GetUint8(data + 111);
+	unsigned char options = DataHelper::GetUint8(data + 112);
+	unsigned short count = DataHelper::GetUint16BE(data + 123);
+	unsigned char startCode = DataHelper::GetUint8(data + 125);
+	uint64_t now = GetMonotonicTime();
+	
+	// The source stopped sending this universe, its data must not be used
+	if(options & SACNOPTION_TERMINATED)
+	{
+		Inform("sACN: A source of universe %d terminated its stream", universe);
+		mMerge->RemoveSource(index, cid);
+		mMerge->Flush();
+		return false;
+	}
+	// Preview data is meant for visualizers, alternate start codes are not dmx data
+	if((options & SACNOPTION_PREVIEW) || startCode != 0x00 || count < 1)
+		return false;
+	
+	if(!mSequences.Accept(index, cid, sequence, now))
+		return false;
+	if(priority > SACNMAXPRIORITY)
+		priority = SACNMAXPRIORITY;
+	
+	// The property values start with the start code
+	int length = count - 1;
+	if(length > SACNMAXCHANNELS)
+		length = SACNMAXCHANNELS;
+	if(length > len - SACNDATAHEADERSIZE)
+		length = len - SACNDATAHEADERSIZE;
+	
+	frame->universe = universe;
+	frame->output = index;
+	frame->syncAddress = syncAddress;
+	frame->cid = cid;
+	frame->priority = priority;
+	frame->time = now;
+	frame->stamp = 0;
+	frame->length = length;
+	frame->data = data + SACNDATAHEADERSIZE;
+	return true;
+}
+
+void SacnReceiver::HandleData(const SacnFrame &frame)
+{
+	mMerge->SetFrame(frame.output, frame.cid, frame.priority, frame.data, frame.length, frame.time,
+		frame.stamp);
+}
+
+bool SacnReceiver::IsSyncActive(unsigned short address, uint64_t now)
+{
+	for(size_t i = 0; i < mSyncUniverses.size(); i++)
+	{
+		SyncUniverse &sync = mSyncUniverses[i];
+		if(sync.address == address)
+			return sync.time != 0 && now - sync.time < SACNSYNCTIMEOUT * 1000000ULL;
+	}
+	
+	// Start listening to the synchronization packets of a new address
+	if(mSyncUniverses.size() == SACNMAXSYNCUNIVERSES || address > SACN_MAXUNIVERSE)
+		return false;
+	if(mRoutes.Lookup(address) < 0 && !JoinUniverse(address))
+		return false;
+	SyncUniverse sync = {address, 0};
+	mSyncUniverses.push_back(sync);
+	return false;
+}
+
+void SacnReceiver::HandleSync(const char *buffer, int len)
+{
+	if(len < SACNSYNCSIZE)
+		return;
+	const unsigned char *data = (const unsigned char *)buffer;
+	if(DataHelper::GetUint32BE(data + 40) != VECTOR_E131_EXTENDED_SYNCHRONIZATION)
+		return;
+	unsigned short address = DataHelper::GetUint16BE(data + 45);
+	
+	size_t i;
+	for(i = 0; i < mSyncUniverses.size(); i++)
+	{
+		if(mSyncUniverses[i].address == address)
+			break;
+	}
+	// No frame refers to this address
+	if(i == mSyncUniverses.size())
+		return;
+	if(mSyncUniverses[i].time == 0)
+		Inform("sACN: Synchronization packets received, universes using sync address %d are synchronized", address);
+	mSyncUniverses[i].time = GetMonotonicTime();
+	
+	for(size_t j = 0; j < mOutputs.size(); j++)
+	{
+		CommitStaged(mOutputs[j], j, address);
+	}
+	mMerge->Flush();
+}
+
+void SacnReceiver::StageFrame(const SacnFrame &frame)
+{
+	Output &output = mOutputs[frame.output];
+	int index = 0;
+	while(index < output.stagedCount && output.staged[index].cid != frame.cid)
+		index++;
+	if(index == output.stagedCount)
+	{
+		// The merge engine would ignore the frame of another source too
+		if(output.stagedCount == MERGE_MAXSOURCES)
+		{
+			Metrics::Add(METRIC_FRAMES_DROPPED);
+			return;
+		}
+		output.stagedCount++;
+	}
+	StagedFrame &staged = output.staged[index];
+	memcpy(staged.data, frame.data, frame.length);
+	staged.length = frame.length;
+	staged.cid = frame.cid;
+	staged.syncAddress = frame.syncAddress;
+	staged.priority = frame.priority;
+	staged.time = frame.time;
+	staged.stamp = frame.stamp;
+}
+
+void SacnReceiver::CommitStaged(Output &output, int index, unsigned short syncAddress)
+{
+	// Keep the frames of sources that use another sync address
+	int kept = 0;
+	for(int i = 0; i < output.stagedCount; i++)
+	{
+		StagedFrame &staged = output.staged[i];
+		if(staged.syncAddress != syncAddress)
+		{
+			if(kept != i)
+				output.staged[kept] = staged;
+			kept++;
+			continue;
+		}
+		mMerge->SetFrame(index, staged.cid, staged.priority, staged.data,
+			staged.length, staged.time, staged.stamp);
+	}
+	output.stagedCount = kept;
+}
+
+void SacnReceiver::CheckSyncTimeouts()
+{
+	uint64_t now = GetMonotonicTime();
+	for(size_t i = 0; i < mSyncUniverses.size(); i++)
+	{
+		SyncUniverse &sync = mSyncUniverses[i];
+		if(sync.time == 0 || now - sync.time < SACNSYNCTIMEOUT * 1000000ULL)
+			continue;
+		Inform("sACN: No synchronization packets received, universes using sync address %d are no longer synchronized",
+			sync.address);
+		sync.time = 0;
+		for(size_t j = 0; j < mOutputs.size(); j++)
+		{
+			CommitStaged(mOutputs[j], j, sync.address);
+		}
+	}
+	mMerge->Flush();
+}
@@ -0,0 +1,166 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _SACNRECEIVER_H_
+#define _SACNRECEIVER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "mergeengine.h"
+#include "timehelper.h"
+#include "routingtable.h"
+#include "sequencetracker.h"
+
+#define SACNPORT 5568
+// Size of a receive slot, the largest packet that is handled is a data packet of 638 bytes
+#define SACNBUFFERSIZE 1024
+// Number of datagrams that are received with one system call
+#define SACNBATCHSIZE 32
+// Requested size of the socket receive buffer
+#define SACNRECEIVEBUFFER (256*1024)
+#define SACNROOTHEADERSIZE 38
+#define SACNDATAHEADERSIZE 126
+#define SACNSYNCSIZE 49
+#define SACNMAXCHANNELS 512
+#define SACNMAXPRIORITY 200
+// Number of synchronization universes that are joined
+#define SACNMAXSYNCUNIVERSES 8
+// Time in ms after which a source is lost, the network data loss timeout of E1.31
+#define SACNSOURCETIMEOUT 2500
+// Time in ms without synchronization packets before frames are output immediately again
+#define SACNSYNCTIMEOUT 2500
+
+// Received E1.31 data packet
+struct SacnFrame {
+	unsigned short universe;
+	// Output that the universe is sent to
+	int output;
+	// Universe of the synchronization packets, 0 when the frame is output immediately
+	unsigned short syncAddress;
+	// Source of the frame, the CID folded to 64 bits
+	uint64_t cid;
+	unsigned char priority;
+	// Receive time in ns
+	uint64_t time;
+	// Receive time of the datagram on the realtime clock, for latency tracing
+	uint64_t stamp;
+	unsigned short length;
+	const unsigned char *data;
+};
+
+// E1.31 (sACN) receiver. Joins the multicast groups of the universes of
+// the outputs only, so the kernel drops the other universes. The sources
+// of a universe are merged by priority in the merge engine.
+class SacnReceiver
+{
+public:
+	SacnReceiver(std::string ip, MergeEngine *merge);
+	~SacnReceiver();
+	
+	bool IsValid() const;
+	// Returns the UDP socket, it becomes readable when Tick has work to do
+	int GetSocket() const;
+	
+	// Handle all received packets
+	void Tick();
+	// Returns the time on the monotonic clock in ns at which HandleTimeouts must
+	// be called, 0 when no universe is synchronized
+	uint64_t GetNextTimeout() const;
+	// End the synchronization of the universes that received no synchronization packets
+	void HandleTimeouts();
+	// Log the statistics of the receiver
+	void ReportStatistics();
+	
+	// Returns true when the packet is a valid data packet for one of our
+	// outputs that is not late
+	bool ParseData(const char *buffer, int len, SacnFrame *frame);
+	// Pass the frame to the merge engine, it is sent to the dmx process at the end of the batch
+	void HandleData(const SacnFrame &frame);
+	
+private:
+	// Frame of a source that is waiting for a synchronization packet
+	struct StagedFrame {
+		uint64_t cid;
+		unsigned short syncAddress;
+		unsigned char priority;
+		unsigned char data[SACNMAXCHANNELS];
+		int length;
+		uint64_t time;
+		uint64_t stamp;
+	};
+	struct Output {
+		unsigned short universe;
+		// Newest frame of every source since the last synchronization packet,
+		// the merge engine does not merge more sources
+		StagedFrame staged[MERGE_MAXSOURCES];
+		int stagedCount;
+	};
+	struct SyncUniverse {
+		unsigned short address;
+		// Time of the last synchronization packet, 0 when none was received
+		uint64_t time;
+	};
+	
+	// Handle the received datagrams in the receive slots
+	void HandleBatch(int count);
+	// Output the frames that wait for this synchronization packet
+	void HandleSync(const char *buffer, int len);
+	// Copy the frame to its output, it is output at the next synchronization packet
+	// Every source of an output has its own staged frame
+	void StageFrame(const SacnFrame &frame);
+	// Pass the frames of an output that wait for the sync address to the merge engine
+	void CommitStaged(Output &output, int index, unsigned short syncAddress);
+	// Output the staged frames of synchronization universes that went quiet
+	void CheckSyncTimeouts();
+	// Returns true when synchronization packets are received for the address
+	// The multicast group of the address is joined when it is new
+	bool IsSyncActive(unsigned short address, uint64_t now);
+	// Join the multicast group of a universe
+	bool JoinUniverse(unsigned short universe);
+	
+	std::vector<Output> mOutputs;
+	// Output index of every universe
+	RoutingTable mRoutes;
+	SequenceTracker mSequences;
+	std::vector<SyncUniverse> mSyncUniverses;
+	MergeEngine *mMerge;
+	struct in_addr mInterface;
+	int mSocket;
+	
+	// Preallocated receive slots for recvmmsg
+	char *mBuffer;
+	struct mmsghdr mMessages[SACNBATCHSIZE];
+	struct iovec mIovecs[SACNBATCHSIZE];
+	// Receive the kernel time stamps of the datagrams
+	char mControls[SACNBATCHSIZE][RECEIVETIME_CONTROLSIZE];
+};
+
+// Returns the multicast address of an sACN universe in network order
+inline in_addr_t GetSacnMulticastAddress(unsigned short universe)
+{
+	return htonl(0xEFFF0000 | universe);
+}
+
+#endif
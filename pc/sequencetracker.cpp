@@ -0,0 +1,139 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <cstddef>
+#include <cassert>
+#include "logger.h"
+#include "sequencetracker.h"
+
+SequenceTracker::SequenceTracker(int universes, uint64_t timeout, SequenceMode_t mode)
+{
+	assert(universes > 0);
+	Source free = {0, 0, 0};
+	mMode = mode;
+	mTimeout = timeout;
+	mSources.assign(universes * SEQUENCETRACKER_SOURCES, free);
+	mReordered = 0;
+	mDuplicates = 0;
+	mGaps = 0;
+	mReportedReordered = 0;
+	mReportedDuplicates = 0;
+	mReportedGaps = 0;
+}
+
+bool SequenceTracker::Accept(int universe, uint64_t source, unsigned char sequence, uint64_t now)
+{
+	assert(universe >= 0 && universe * SEQUENCETRACKER_SOURCES < (int)mSources.size());
+	
+	// The source does not use sequence numbers
+	if(mMode == SEQUENCE_ARTNET && sequence == 0)
+		return true;
+	
+	Source *slots = &mSources[universe * SEQUENCETRACKER_SOURCES];
+	Source *slot = NULL;
+	Source *oldest = &slots[0];
+	for(int i = 0; i < SEQUENCETRACKER_SOURCES; i++)
+	{
+		if(slots[i].time != 0 && slots[i].id == source)
+		{
+			slot = &slots[i];
+			break;
+		}
+		if(slots[i].time < oldest->time)
+			oldest = &slots[i];
+	}
+	
+	// A new source replaces the source that was quiet for the longest time
+	// After a timeout the source could have restarted its sequence
+	if(slot == NULL || now - slot->time >= mTimeout)
+	{
+		if(slot == NULL)
+			slot = oldest;
+		slot->id = source;
+		slot->sequence = sequence;
+		slot->time = now;
+		return true;
+	}
+	
+	int distance = GetDistance(slot->sequence, sequence);
+	if(distance == 0)
+	{
+		mDuplicates++;
+		return false;
+	}
+	if(distance < 0)
+	{
+		mReordered++;
+		return false;
+	}
+	mGaps += distance - 1;
+	slot->sequence = sequence;
+	slot->time = now;
+	return true;
+}
+
+int SequenceTracker::GetDistance(unsigned char last, unsigned char sequence) const
+{
+	if(mMode == SEQUENCE_SACN)
+	{
+		int distance = (signed char)(sequence - last);
+		// A packet far behind the last one starts a new sequence
+		if(distance <= -SEQUENCETRACKER_SACNWINDOW)
+			return 1;
+		return distance;
+	}
+	
+	// Distance in the 255 values from 1 to 255
+	int distance = ((int)sequence - last + 255) % 255;
+	if(distance > SEQUENCETRACKER_WINDOW)
+		return -1;
+	return distance;
+}
+
+uint64_t SequenceTracker::GetReordered() const
+{
+	return mReordered;
+}
+
+uint64_t SequenceTracker::GetDuplicates() const
+{
+	return mDuplicates;
+}
+
+uint64_t SequenceTracker::GetGaps() const
+{
+	return mGaps;
+}
+
+void SequenceTracker::Report(const char *name)
+{
+	if(mReordered == mReportedReordered && mDuplicates == mReportedDuplicates &&
+		mGaps == mReportedGaps)
+		return;
+	Inform("%s: %llu late packets and %llu duplicate packets dropped, %llu packets lost", name,
+		(unsigned long long)(mReordered - mReportedReordered),
+		(unsigned long long)(mDuplicates - mReportedDuplicates),
+		(unsigned long long)(mGaps - mReportedGaps));
+	mReportedReordered = mReordered;
+	mReportedDuplicates = mDuplicates;
+	mReportedGaps = mGaps;
+}
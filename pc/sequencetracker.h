@@ -0,0 +1,93 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _SEQUENCETRACKER_H_
+#define _SEQUENCETRACKER_H_
+
+#include <stdint.h>
+#include <vector>
+#include "mergeengine.h"
+
+// Number of sources that are tracked for every universe, as many as the merge engine merges
+#define SEQUENCETRACKER_SOURCES MERGE_MAXSOURCES
+// Number of sequence numbers ahead of the last one that are accepted as new,
+// older sequence numbers are late
+#define SEQUENCETRACKER_WINDOW 127
+// sACN packets up to this many sequence numbers behind the last one are late,
+// packets further behind mean that the source restarted
+#define SEQUENCETRACKER_SACNWINDOW 20
+
+enum SequenceMode_t {
+	// Art-Net: sequence numbers run from 1 to 255 and wrap around to 1, 0
+	// means that the source does not use sequence numbers
+	SEQUENCE_ARTNET,
+	// sACN: sequence numbers run from 0 to 255, as specified by E1.31
+	SEQUENCE_SACN,
+};
+
+// Tracks the sequence numbers of every source of every universe. Packets
+// that are older than the last packet of the same source are rejected, so
+// reordered packets do not snap the output back to old values.
+class SequenceTracker
+{
+public:
+	// timeout is the time in ns after which the sequence of a source is restarted
+	SequenceTracker(int universes, uint64_t timeout, SequenceMode_t mode = SEQUENCE_ARTNET);
+	
+	// Returns true when the packet is newer than the last packet of the source
+	// source identifies the sender, for example its address and port
+	bool Accept(int universe, uint64_t source, unsigned char sequence, uint64_t now);
+	
+	// Number of packets that arrived after a newer packet
+	uint64_t GetReordered() const;
+	// Number of packets that were received twice
+	uint64_t GetDuplicates() const;
+	// Number of sequence numbers that were skipped
+	uint64_t GetGaps() const;
+	
+	// Log the counters with the given name when they changed since the last report
+	void Report(const char *name);
+	
+private:
+	struct Source {
+		uint64_t id;
+		unsigned char sequence;
+		// Time of the last accepted packet, 0 when the slot is free
+		uint64_t time;
+	};
+	
+	// Returns the number of sequence numbers from last to sequence, 0 for a
+	// duplicate and a negative number for a late packet
+	int GetDistance(unsigned char last, unsigned char sequence) const;
+	
+	SequenceMode_t mMode;
+	uint64_t mTimeout;
+	// SEQUENCETRACKER_SOURCES slots for every universe
+	std::vector<Source> mSources;
+	uint64_t mReordered;
+	uint64_t mDuplicates;
+	uint64_t mGaps;
+	uint64_t mReportedReordered;
+	uint64_t mReportedDuplicates;
+	uint64_t mReportedGaps;
+};
+
+#endif
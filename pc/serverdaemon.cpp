@@ -20,12 +20,10 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.*/
 
-#define USELIBARTNET
-
-
 #include <unistd.h>
 #include <stdint.h>
 #include <cerrno> 
+#include <sys/epoll.h>
 #include "global.h"
 #include "logger.h"
 #include "childs.h"
@@ -33,110 +31,218 @@ THE SOFTWARE.*/
 #include "datahelper.h"
 #include "messages.h"
 #include "settings.h"
+#include "eventloop.h"
+#include "timehelper.h"
+#include "artnetengine.h"
+#include "sacnreceiver.h"
+#include "mergeengine.h"
+#include "outputconfig.h"
+#include "metricsserver.h"
+#include "stringhelper.h"
 
-#ifdef USELIBARTNET
-#include <artnet/artnet.h>
-#else
-#include "artnet.h"
-#endif
+struct ServerChildContext {
+	IPC *ipc;
+	MergeEngine *merge;
+	ArtNetEngine *artnet;
+	// NULL when no output uses sACN
+	SacnReceiver *sacn;
+	EventLoop *loop;
+	int channelCount;
+	// One-shot timer for the first timeout of the receivers and the merge engine
+	int timeoutTimer;
+	// Deadline that the timer is armed with, 0 when it is disarmed
+	uint64_t timeoutDeadline;
+};
 
-int dmx_handler(artnet_node n, int prt, void *d)
+// Arm the timeout timer for the first timeout, so an idle server does not wake up
+static void UpdateTimeoutTimer(ServerChildContext *context)
 {
-	IPC *ipc = (IPC *)d;
-	
-	
-	int len;
-	uint8_t *data;
-	
-	if(prt == 0) {
-		data = artnet_read_dmx(n, prt, &len);
-		IPCMessage *message = SetChannelsMessage(1, len, data);
-		ipc->SendMessage(*message);
-		delete message;
+	uint64_t deadlines[3] = {
+		context->artnet->GetNextTimeout(),
+		context->sacn != NULL ? context->sacn->GetNextTimeout() : 0,
+		context->merge->GetNextTimeout(),
+	};
+	uint64_t next = 0;
+	for(int i = 0; i < 3; i++)
+	{
+		if(deadlines[i] != 0 && (next == 0 || deadlines[i] < next))
+			next = deadlines[i];
 	}
-	
-	return 0;
+	// A timer that expires too early finds nothing to expire and is armed again,
+	// so it is only moved forward which saves a system call for most batches
+	if(next == 0 || (context->timeoutDeadline != 0 && context->timeoutDeadline <= next))
+		return;
+	if(context->loop->SetTimerDeadline(context->timeoutTimer, next))
+		context->timeoutDeadline = next;
+}
+
+// Called by the event loop when the IPC pipe is readable
+static void HandleIpcEvent(int fd, uint32_t events, void *data)
+{
+	ServerChildContext *context = (ServerChildContext *)data;
+	IPC *ipc = context->ipc;
+	ipc->Tick();
+	const IPCMessage *message;
+	while((message = ipc->GetMessage()) != NULL)
+	{
+		//Debug("Received message: %s", message->ToString().c_str());
+		
+		switch(message->GetType())
+		{
+		case MSG_GETINFORESPONSE:
+			context->channelCount = DataHelper::GetInt32((unsigned char *)message->GetData());
+			break;
+		case MSG_GETCHANNELSRESPONSE:
+			break;
+		}
+	}
+	if((events & (EPOLLHUP | EPOLLERR)) && !(events & EPOLLIN))
+	{
+		Error("IPC channel closed");
+		context->loop->Stop();
+	}
+}
+
+// Called by the event loop when the Art-Net socket is readable
+static void HandleArtNetEvent(int fd, uint32_t events, void *data)
+{
+	ServerChildContext *context = (ServerChildContext *)data;
+	context->artnet->Tick();
+	UpdateTimeoutTimer(context);
+}
+
+// Called by the event loop when the sACN socket is readable
+static void HandleSacnEvent(int fd, uint32_t events, void *data)
+{
+	ServerChildContext *context = (ServerChildContext *)data;
+	context->sacn->Tick();
+	UpdateTimeoutTimer(context);
+}
+
+// Called at the first deadline to let the receivers and the merge engine expire their state
+static void HandleTimeoutTimer(uint64_t expirations, void *data)
+{
+	ServerChildContext *context = (ServerChildContext *)data;
+	context->timeoutDeadline = 0;
+	context->artnet->HandleTimeouts();
+	if(context->sacn != NULL)
+		context->sacn->HandleTimeouts();
+	context->merge->HandleTimeouts(GetMonotonicTime());
+	UpdateTimeoutTimer(context);
+}
+
+// Called periodically to report the statistics
+static void HandleStatisticsTimer(uint64_t expirations, void *data)
+{
+	ServerChildContext *context = (ServerChildContext *)data;
+	context->artnet->ReportStatistics();
+	if(context->sacn != NULL)
+		context->sacn->ReportStatistics();
+	context->merge->ReportStatistics();
+	context->ipc->ReportQueueStatistics("IPC queue to the dmx process");
 }
 
-int serverChild(int readfd, int writefd)
+int serverChild(int readfd, int writefd, SharedUniverse *shared)
 {
 	IPC *ipc;
 	// Initialize IPC
 	ipc = new IPC(readfd, writefd);
+	ipc->SetSharedUniverse(shared);
 	
-	// Initialize artnet
-#ifdef USELIBARTNET
-	artnet_node node = artnet_new(Settings::GetArtNetIp().c_str(), 0);
-	
-	if(node == NULL) {
-		Error("Could not create Art-Net node");
+	EventLoop loop;
+	if(!loop.IsValid())
+	{
+		delete ipc;
 		return EXIT_COULD_NOT_START_SERVER;
 	}
 	
-	artnet_set_short_name(node, Settings::GetArtNetShortName().c_str());
-	artnet_set_long_name(node, Settings::GetArtNetLongName().c_str());
-	artnet_set_node_type(node, ARTNET_NODE);
-	artnet_set_port_type(node, 0, ARTNET_ENABLE_OUTPUT, ARTNET_PORT_DMX);
-	artnet_set_port_addr(node, 0, ARTNET_OUTPUT_PORT, 0);
-	//artnet_set_subnet_addr(node, 0);
+	ipc->SetEventLoop(&loop);
+	ipc->SetQueueLimit(Settings::GetIPCQueueSize(), ParseDropPolicy(Settings::GetIPCDropPolicy()));
+	ipc->SetQueueMetric(METRIC_SERVER_IPC_QUEUE);
+	loop.SetMetrics(METRIC_SERVER_LOOP_ITERATIONS, METRIC_SERVER_LOOP_TIME);
 	
-	if(artnet_set_dmx_handler(node, dmx_handler, ipc)) {
-		Error("Failed to install handler");
+	ServerChildContext context;
+	context.ipc = ipc;
+	context.loop = &loop;
+	context.channelCount = 0;
+	context.timeoutDeadline = 0;
+	
+	// The receivers pass their frames to the merge engine, which sends them to the dmx process
+	std::vector<OutputConfig> outputs = GetOutputConfigs();
+	MergeEngine merge(ipc, outputs.size(), ParseMergeMode(Settings::GetMergeMode()),
+		Settings::GetMergeTimeout() * 1000000ULL);
+	context.merge = &merge;
+	
+	// Initialize artnet
+	ArtNetEngine *artnet = CreateArtNetEngine(Settings::GetArtNetEngine(),
+		Settings::GetArtNetIp(), &merge);
+	if(artnet == NULL || !artnet->IsValid())
+	{
+		Error("Could not start the Art-Net node");
+		delete artnet;
+		delete ipc;
 		return EXIT_COULD_NOT_START_SERVER;
 	}
+	context.artnet = artnet;
+	int artnetSocket = artnet->GetSocket();
+	
+	// Initialize sACN when an output uses it
+	context.sacn = NULL;
+	for(size_t i = 0; i < outputs.size(); i++)
+	{
+		if(outputs[i].sacnUniverse == 0)
+			continue;
+		context.sacn = new SacnReceiver(Settings::GetSacnIp(), &merge);
+		if(!context.sacn->IsValid())
+		{
+			Error("Could not start the sACN receiver");
+			delete context.sacn;
+			delete artnet;
+			delete ipc;
+			return EXIT_COULD_NOT_START_SERVER;
+		}
+		break;
+	}
 	
-	artnet_start(node);
+	// The timer is only armed while something can time out
+	context.timeoutTimer = loop.AddOneShotTimer(HandleTimeoutTimer, &context);
 	
-#else
-	ArtNet artnet(Settings::GetArtNetIp().c_str(), ipc);
-	if(!artnet.IsValid())
+	// Handle every datagram as soon as it arrives and every message from
+	// the dmx process on the same loop
+	if(!loop.AddFd(readfd, EPOLLIN, HandleIpcEvent, &context) ||
+		!loop.AddFd(artnetSocket, EPOLLIN, HandleArtNetEvent, &context) ||
+		context.timeoutTimer < 0 ||
+		(context.sacn != NULL &&
+		!loop.AddFd(context.sacn->GetSocket(), EPOLLIN, HandleSacnEvent, &context)))
+	{
+		delete context.sacn;
+		delete artnet;
+		delete ipc;
 		return EXIT_COULD_NOT_START_SERVER;
-#endif
-	
-	int channelCount = 0;
+	}
+	if(Settings::GetStatisticsInterval() > 0)
+	{
+		loop.AddTimer(Settings::GetStatisticsInterval() * 1000, HandleStatisticsTimer, &context);
+	}
 	
-	int i = 1;
-	// Main loop
-	while(running)
+	// Serve the metrics of both processes
+	MetricsServer *metrics = NULL;
+	if(ToLower(Settings::GetMetricsEndpoint()) != "off")
 	{
-		// Handle IPC
-		ipc->Tick();
-		while(ipc->GetAvailableMessages() > 0)
+		metrics = new MetricsServer(Settings::GetMetricsEndpoint(), &loop);
+		if(!metrics->IsValid())
 		{
-			IPCMessage *message;
-			if((message = ipc->GetMessage()) != NULL)
-			{
-				//Debug("Received message: %s", message->ToString().c_str());
-				
-				switch(message->GetType())
-				{
-				case MSG_GETINFORESPONSE:
-					channelCount = DataHelper::GetInt32((unsigned char *)message->GetData());
-					break;
-				case MSG_GETCHANNELSRESPONSE:
-					break;
-				}
-				delete message;
-			}
+			Warn("Could not serve the metrics on %s", Settings::GetMetricsEndpoint().c_str());
 		}
-		
-		// Handle Artnet
-#ifdef USELIBARTNET
-		// This is blocking
-		artnet_read(node, 0);
-#else
-		artnet.Tick();
-#endif
-		usleep(1000*15); // sleep for 15ms
 	}
 	
-#ifdef USELIBARTNET
-		// This is blocking
-	artnet_stop(node);
-	artnet_destroy(node);
-#else
-#endif
+	// Main loop
+	loop.Run(&running);
+	
+	delete metrics;
+	delete context.sacn;
+	delete artnet;
+	delete ipc;
 	
 	return EXIT_OK;
 }
-
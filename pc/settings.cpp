@@ -44,6 +44,30 @@ std::string Settings::mArtNetIp = DEFAULT_ARTNETIP;
 std::string Settings::mArtNetLongName = DEFAULT_ARTNETLONGNAME;
 std::string Settings::mArtNetShortName = DEFAULT_ARTNETSHORTNAME;
 std::string Settings::mInitialState = DEFAULT_INITIALSTATE;
+int Settings::mStatisticsInterval = DEFAULT_STATISTICSINTERVAL;
+std::string Settings::mArtNetEngine = DEFAULT_ARTNETENGINE;
+int Settings::mArtNetNet = DEFAULT_ARTNETNET;
+int Settings::mArtNetSubNet = DEFAULT_ARTNETSUBNET;
+int Settings::mArtNetUniverse = DEFAULT_ARTNETUNIVERSE;
+std::string Settings::mIPCTransport = DEFAULT_IPCTRANSPORT;
+int Settings::mIPCQueueSize = DEFAULT_IPCQUEUESIZE;
+std::string Settings::mIPCDropPolicy = DEFAULT_IPCDROPPOLICY;
+std::string Settings::mSPIBackend = DEFAULT_SPIBACKEND;
+int Settings::mSPITransferDelay = DEFAULT_SPITRANSFERDELAY;
+std::string Settings::mSPICSChange = DEFAULT_SPICSCHANGE;
+std::string Settings::mSimulatorTrace = DEFAULT_SIMULATORTRACE;
+std::string Settings::mOutputs = DEFAULT_OUTPUTS;
+int Settings::mArtNetSyncTimeout = DEFAULT_ARTNETSYNCTIMEOUT;
+std::string Settings::mSacnUniverses = DEFAULT_SACNUNIVERSES;
+std::string Settings::mSacnIp = DEFAULT_SACNIP;
+std::string Settings::mMergeMode = DEFAULT_MERGEMODE;
+int Settings::mMergeTimeout = DEFAULT_MERGETIMEOUT;
+int Settings::mOutputRate = DEFAULT_OUTPUTRATE;
+std::string Settings::mMetricsEndpoint = DEFAULT_METRICSENDPOINT;
+int Settings::mOutputPriority = DEFAULT_OUTPUTPRIORITY;
+int Settings::mOutputCpu = DEFAULT_OUTPUTCPU;
+std::string Settings::mLockMemory = DEFAULT_LOCKMEMORY;
+int Settings::mWakeupTest = DEFAULT_WAKEUPTEST;
 std::string Settings::mFileName = CONFIG_FILE;
 
 void Settings::SetFileName(std::string fileName)
@@ -233,6 +257,54 @@ void Settings::Load(int argc, char **argv)
 				mArtNetLongName = ReadString(value, DEFAULT_ARTNETLONGNAME);
 			} else if( key == "ArtNetShortName" ) {
 				mArtNetShortName = ReadString(value, DEFAULT_ARTNETSHORTNAME);
+			} else if( key == "StatisticsInterval" ) {
+				mStatisticsInterval = ReadInt(value, DEFAULT_STATISTICSINTERVAL);
+			} else if( key == "ArtNetEngine" ) {
+				mArtNetEngine = ReadString(value, DEFAULT_ARTNETENGINE);
+			} else if( key == "ArtNetNet" ) {
+				mArtNetNet = ReadInt(value, DEFAULT_ARTNETNET);
+			} else if( key == "ArtNetSubNet" ) {
+				mArtNetSubNet = ReadInt(value, DEFAULT_ARTNETSUBNET);
+			} else if( key == "ArtNetUniverse" ) {
+				mArtNetUniverse = ReadInt(value, DEFAULT_ARTNETUNIVERSE);
+			} else if( key == "IPCTransport" ) {
+				mIPCTransport = ReadString(value, DEFAULT_IPCTRANSPORT);
+			} else if( key == "IPCQueueSize" ) {
+				mIPCQueueSize = ReadInt(value, DEFAULT_IPCQUEUESIZE);
+			} else if( key == "IPCDropPolicy" ) {
+				mIPCDropPolicy = ReadString(value, DEFAULT_IPCDROPPOLICY);
+			} else if( key == "SPIBackend" ) {
+				mSPIBackend = ReadString(value, DEFAULT_SPIBACKEND);
+			} else if( key == "SPITransferDelay" ) {
+				mSPITransferDelay = ReadInt(value, DEFAULT_SPITRANSFERDELAY);
+			} else if( key == "SPICSChange" ) {
+				mSPICSChange = ReadString(value, DEFAULT_SPICSCHANGE);
+			} else if( key == "SimulatorTrace" ) {
+				mSimulatorTrace = ReadString(value, DEFAULT_SIMULATORTRACE);
+			} else if( key == "Outputs" ) {
+				mOutputs = ReadString(value, DEFAULT_OUTPUTS);
+			} else if( key == "ArtNetSyncTimeout" ) {
+				mArtNetSyncTimeout = ReadInt(value, DEFAULT_ARTNETSYNCTIMEOUT);
+			} else if( key == "SacnUniverses" ) {
+				mSacnUniverses = ReadString(value, DEFAULT_SACNUNIVERSES);
+			} else if( key == "SacnIp" ) {
+				mSacnIp = ReadString(value, DEFAULT_SACNIP);
+			} else if( key == "MergeMode" ) {
+				mMergeMode = ReadString(value, DEFAULT_MERGEMODE);
+			} else if( key == "MergeTimeout" ) {
+				mMergeTimeout = ReadInt(value, DEFAULT_MERGETIMEOUT);
+			} else if( key == "OutputRate" ) {
+				mOutputRate = ReadInt(value, DEFAULT_OUTPUTRATE);
+			} else if( key == "MetricsEndpoint" ) {
+				mMetricsEndpoint = ReadString(value, DEFAULT_METRICSENDPOINT);
+			} else if( key == "OutputPriority" ) {
+				mOutputPriority = ReadInt(value, DEFAULT_OUTPUTPRIORITY);
+			} else if( key == "OutputCpu" ) {
+				mOutputCpu = ReadInt(value, DEFAULT_OUTPUTCPU);
+			} else if( key == "LockMemory" ) {
+				mLockMemory = ReadString(value, DEFAULT_LOCKMEMORY);
+			} else if( key == "WakeupTest" ) {
+				mWakeupTest = ReadInt(value, DEFAULT_WAKEUPTEST);
 			} else {
 				cerr << "Unknown key found in configuration file: \"" << key << "\"" << endl;
 				continue;
@@ -300,6 +372,19 @@ void Settings::Save()
 		content.push_back("SPIPort = 0");
 		content.push_back("\n# The SPI port speed in kHz. ");
 		content.push_back("SPISpeed = 60");
+		content.push_back("\n# How the SPI port is accessed(spidev, wiringpi, simulator, null)");
+		content.push_back("# spidev sends all commands of a frame with a single call to the kernel");
+		content.push_back("# and falls back to wiringpi when the device can not be opened");
+		content.push_back("# simulator simulates the interface, no hardware is needed");
+		content.push_back("# null discards all commands");
+		content.push_back("SPIBackend = spidev");
+		content.push_back("\n# Time in microseconds between two commands, used by the spidev backend");
+		content.push_back("SPITransferDelay = 20");
+		content.push_back("\n# Deselect the interface between two commands(on, off)");
+		content.push_back("SPICSChange = on");
+		content.push_back("# Unix socket that the simulator sends the channel values to after every update");
+		content.push_back("# Used by dmxd-bench, off disables it");
+		content.push_back("SimulatorTrace = off");
 		content.push_back("\n# The user that is used for the dmx communication");
 		content.push_back("SPIUser = root");
 		content.push_back("\n########## Server settings ##########");
@@ -307,6 +392,32 @@ void Settings::Save()
 		content.push_back("ServerUser = http");
 		content.push_back("# Initial state of channels(on, off)");
 		content.push_back("InitialState = on");
+		content.push_back("# Universes that are output and the SPI port of their interface");
+		content.push_back("# A comma separated list of net:subnet:universe@port, for example 0:0:0@0, 0:0:1@1");
+		content.push_back("# single outputs the universe of the Art-Net settings on SPIPort");
+		content.push_back("Outputs = single");
+		content.push_back("# Rate in Hz at which the outputs are written, for example 44 or 30");
+		content.push_back("# Every tick writes the newest channels, 0 writes every frame as soon as it arrives");
+		content.push_back("OutputRate = 0");
+		content.push_back("\n########## Real-time settings ##########");
+		content.push_back("# SCHED_FIFO priority of the output threads(1-99, 0 is off)");
+		content.push_back("OutputPriority = 0");
+		content.push_back("# CPU core that the output threads are pinned to(-1 is off)");
+		content.push_back("OutputCpu = -1");
+		content.push_back("# Lock the memory of the dmx process after startup, so it is never paged out(on, off)");
+		content.push_back("LockMemory = off");
+		content.push_back("# Milliseconds that the wakeup latency of the output threads is measured at");
+		content.push_back("# startup, the worst case is logged(0 is off)");
+		content.push_back("WakeupTest = 0");
+		content.push_back("\n########## IPC settings ##########");
+		content.push_back("# How channel values are passed to the dmx process(pipe, shm)");
+		content.push_back("# shm uses shared memory which avoids copying the values through the kernel");
+		content.push_back("IPCTransport = pipe");
+		content.push_back("# Maximum number of bytes that are queued when the other process is busy");
+		content.push_back("IPCQueueSize = 65536");
+		content.push_back("# Which channel frames are dropped when the queue is full(stale, oldest, newest)");
+		content.push_back("# stale also drops queued frames that are overwritten by a newer frame");
+		content.push_back("IPCDropPolicy = stale");
 		content.push_back("\n########## Art-Net settings ##########");
 		content.push_back("# The IP address that Art-Net binds to");
 		content.push_back("ArtNetIp = 0.0.0.0");
@@ -314,6 +425,33 @@ void Settings::Save()
 		content.push_back("ArtNetLongName = SPI-DMX Art-Net daemon http://www.robojan.nl");
 		content.push_back("# The short name for the Art-Net node(max 17 characters)");
 		content.push_back("ArtNetShortName = SPI-DMX daemon");
+		content.push_back("# The Art-Net implementation that is used(native, libartnet)");
+		content.push_back("ArtNetEngine = native");
+		content.push_back("# The Art-Net net(0-127), subnet(0-15) and universe(0-15) of the output port");
+		content.push_back("ArtNetNet = 0");
+		content.push_back("ArtNetSubNet = 0");
+		content.push_back("ArtNetUniverse = 0");
+		content.push_back("# Frames are held until the next ArtSync while ArtSync packets are received");
+		content.push_back("# Time in milliseconds without ArtSync before frames are output immediately again(0 is off)");
+		content.push_back("ArtNetSyncTimeout = 4000");
+		content.push_back("\n########## sACN settings ##########");
+		content.push_back("# sACN (E1.31) universes of the outputs(off, auto or a comma separated list)");
+		content.push_back("# auto receives universe port-address + 1 for every output, a list has one universe per output");
+		content.push_back("SacnUniverses = off");
+		content.push_back("# The IP address of the interface that joins the multicast groups of the universes");
+		content.push_back("SacnIp = 0.0.0.0");
+		content.push_back("\n########## Merge settings ##########");
+		content.push_back("# How the frames of several sources of a universe are merged(htp, ltp)");
+		content.push_back("# Only the sources with the highest priority are merged, Art-Net sources have priority 100");
+		content.push_back("MergeMode = htp");
+		content.push_back("# Time in milliseconds after which a source that stopped sending is no longer merged");
+		content.push_back("MergeTimeout = 2500");
+		content.push_back("\n########## Statistics settings ##########");
+		content.push_back("# Interval in seconds between statistics reports in the log(0 is off)");
+		content.push_back("StatisticsInterval = 60");
+		content.push_back("# Port on localhost or path of a Unix socket that serves the metrics in the");
+		content.push_back("# Prometheus text format (off disables it)");
+		content.push_back("MetricsEndpoint = off");
 	}
 
 	// Modify the content so that it has the current configuration
@@ -356,6 +494,54 @@ void Settings::Save()
 			keyValuePair << mArtNetLongName;
 		} else if( key == "ArtNetShortName" ) {
 			keyValuePair << mArtNetShortName;
+		} else if( key == "StatisticsInterval" ) {
+			keyValuePair << mStatisticsInterval;
+		} else if( key == "ArtNetEngine" ) {
+			keyValuePair << mArtNetEngine;
+		} else if( key == "ArtNetNet" ) {
+			keyValuePair << mArtNetNet;
+		} else if( key == "ArtNetSubNet" ) {
+			keyValuePair << mArtNetSubNet;
+		} else if( key == "ArtNetUniverse" ) {
+			keyValuePair << mArtNetUniverse;
+		} else if( key == "IPCTransport" ) {
+			keyValuePair << mIPCTransport;
+		} else if( key == "IPCQueueSize" ) {
+			keyValuePair << mIPCQueueSize;
+		} else if( key == "IPCDropPolicy" ) {
+			keyValuePair << mIPCDropPolicy;
+		} else if( key == "SPIBackend" ) {
+			keyValuePair << mSPIBackend;
+		} else if( key == "SPITransferDelay" ) {
+			keyValuePair << mSPITransferDelay;
+		} else if( key == "SPICSChange" ) {
+			keyValuePair << mSPICSChange;
+		} else if( key == "SimulatorTrace" ) {
+			keyValuePair << mSimulatorTrace;
+		} else if( key == "Outputs" ) {
+			keyValuePair << mOutputs;
+		} else if( key == "ArtNetSyncTimeout" ) {
+			keyValuePair << mArtNetSyncTimeout;
+		} else if( key == "SacnUniverses" ) {
+			keyValuePair << mSacnUniverses;
+		} else if( key == "SacnIp" ) {
+			keyValuePair << mSacnIp;
+		} else if( key == "MergeMode" ) {
+			keyValuePair << mMergeMode;
+		} else if( key == "MergeTimeout" ) {
+			keyValuePair << mMergeTimeout;
+		} else if( key == "OutputRate" ) {
+			keyValuePair << mOutputRate;
+		} else if( key == "MetricsEndpoint" ) {
+			keyValuePair << mMetricsEndpoint;
+		} else if( key == "OutputPriority" ) {
+			keyValuePair << mOutputPriority;
+		} else if( key == "OutputCpu" ) {
+			keyValuePair << mOutputCpu;
+		} else if( key == "LockMemory" ) {
+			keyValuePair << mLockMemory;
+		} else if( key == "WakeupTest" ) {
+			keyValuePair << mWakeupTest;
 		} else {
 			cerr << "Unknown key found in configuration file: \"" << key << "\"" << endl;
 			continue;
@@ -422,4 +608,122 @@ std::string Settings::GetInitialState()
 	return mInitialState;
 }
 
+int Settings::GetStatisticsInterval()
+{
+	return mStatisticsInterval;
+}
+
+std::string Settings::GetArtNetEngine()
+{
+	return mArtNetEngine;
+}
+
+int Settings::GetArtNetNet()
+{
+	return mArtNetNet;
+}
+
+int Settings::GetArtNetSubNet()
+{
+	return mArtNetSubNet;
+}
+
+int Settings::GetArtNetUniverse()
+{
+	return mArtNetUniverse;
+}
+
+std::string Settings::GetIPCTransport()
+{
+	return mIPCTransport;
+}
+
+int Settings::GetIPCQueueSize()
+{
+	return mIPCQueueSize;
+}
+
+std::string Settings::GetIPCDropPolicy()
+{
+	return mIPCDropPolicy;
+}
+
+std::string Settings::GetSPIBackend()
+{
+	return mSPIBackend;
+}
+
+int Settings::GetSPITransferDelay()
+{
+	return mSPITransferDelay;
+}
+
+std::string Settings::GetSPICSChange()
+{
+	return mSPICSChange;
+}
+
+std::string Settings::GetSimulatorTrace()
+{
+	return mSimulatorTrace;
+}
 
+std::string Settings::GetOutputs()
+{
+	return mOutputs;
+}
+
+int Settings::GetArtNetSyncTimeout()
+{
+	return mArtNetSyncTimeout;
+}
+
+std::string Settings::GetSacnUniverses()
+{
+	return mSacnUniverses;
+}
+
+std::string Settings::GetSacnIp()
+{
+	return mSacnIp;
+}
+
+std::string Settings::GetMergeMode()
+{
+	return mMergeMode;
+}
+
+int Settings::GetMergeTimeout()
+{
+	return mMergeTimeout;
+}
+
+int Settings::GetOutputRate()
+{
+	return mOutputRate;
+}
+
+std::string Settings::GetMetricsEndpoint()
+{
+	return mMetricsEndpoint;
+}
+
+int Settings::GetOutputPriority()
+{
+	return mOutputPriority;
+}
+
+int Settings::GetOutputCpu()
+{
+	return mOutputCpu;
+}
+
+std::string Settings::GetLockMemory()
+{
+	return mLockMemory;
+}
+
+int Settings::GetWakeupTest()
+{
+	return mWakeupTest;
+}
@@ -45,6 +45,30 @@ public:
 	static std::string GetArtNetLongName();
 	static std::string GetArtNetShortName();
 	static std::string GetInitialState();
+	static int GetStatisticsInterval();
+	static std::string GetArtNetEngine();
+	static int GetArtNetNet();
+	static int GetArtNetSubNet();
+	static int GetArtNetUniverse();
+	static std::string GetIPCTransport();
+	static int GetIPCQueueSize();
+	static std::string GetIPCDropPolicy();
+	static std::string GetSPIBackend();
+	static int GetSPITransferDelay();
+	static std::string GetSPICSChange();
+	static std::string GetSimulatorTrace();
+	static std::string GetOutputs();
+	static int GetArtNetSyncTimeout();
+	static std::string GetSacnUniverses();
+	static std::string GetSacnIp();
+	static std::string GetMergeMode();
+	static int GetMergeTimeout();
+	static int GetOutputRate();
+	static std::string GetMetricsEndpoint();
+	static int GetOutputPriority();
+	static int GetOutputCpu();
+	static std::string GetLockMemory();
+	static int GetWakeupTest();
 	
 
 private:
@@ -62,6 +86,30 @@ private:
 	static std::string mArtNetLongName;
 	static std::string mArtNetShortName;
 	static std::string mInitialState;
+	static int mStatisticsInterval;
+	static std::string mArtNetEngine;
+	static int mArtNetNet;
+	static int mArtNetSubNet;
+	static int mArtNetUniverse;
+	static std::string mIPCTransport;
+	static int mIPCQueueSize;
+	static std::string mIPCDropPolicy;
+	static std::string mSPIBackend;
+	static int mSPITransferDelay;
+	static std::string mSPICSChange;
+	static std::string mSimulatorTrace;
+	static std::string mOutputs;
+	static int mArtNetSyncTimeout;
+	static std::string mSacnUniverses;
+	static std::string mSacnIp;
+	static std::string mMergeMode;
+	static int mMergeTimeout;
+	static int mOutputRate;
+	static std::string mMetricsEndpoint;
+	static int mOutputPriority;
+	static int mOutputCpu;
+	static std::string mLockMemory;
+	static int mWakeupTest;
 	static std::string mFileName;
 
 };
@@ -0,0 +1,169 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cassert>
+#include <new>
+#include "logger.h"
+#include "metrics.h"
+#include "shareduniverse.h"
+
+SharedUniverse::SharedUniverse(int outputs)
+{
+	assert(outputs > 0);
+	mOutputs = outputs;
+	mSize = sizeof(Header) + outputs * sizeof(Frame);
+	mHeader = NULL;
+	mFrames = NULL;
+	mSkippedFrames = 0;
+	mReadSequence.resize(outputs, 0);
+	
+	mDoorbell = eventfd(0, EFD_NONBLOCK);
+	if(mDoorbell < 0)
+	{
+		Error("Could not create the shared memory doorbell: %s", strerror(errno));
+	}
+	
+	mMemory = mmap(NULL, mSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(mMemory == MAP_FAILED)
+	{
+		Error("Could not create shared memory: %s", strerror(errno));
+		mMemory = NULL;
+		return;
+	}
+	
+	mHeader = new(mMemory) Header;
+	mHeader->pending.store(0);
+	mFrames = (Frame *)((uint8_t *)mMemory + sizeof(Header));
+	for(int i = 0; i < outputs; i++)
+	{
+		Frame *frame = new(&mFrames[i]) Frame;
+		frame->sequence.store(0);
+		frame->address = 1;
+		frame->count = 0;
+		frame->stamp = 0;
+	}
+}
+
+SharedUniverse::~SharedUniverse()
+{
+	if(mMemory != NULL)
+		munmap(mMemory, mSize);
+	if(mDoorbell >= 0)
+		close(mDoorbell);
+}
+
+bool SharedUniverse::IsValid() const
+{
+	return mMemory != NULL && mDoorbell >= 0;
+}
+
+int SharedUniverse::GetOutputCount() const
+{
+	return mOutputs;
+}
+
+void SharedUniverse::Write(int output, int address, int count, const uint8_t *values, uint64_t stamp)
+{
+	assert(IsValid());
+	assert(output >= 0 && output < mOutputs);
+	if(count > SHAREDUNIVERSE_MAXCHANNELS)
+		count = SHAREDUNIVERSE_MAXCHANNELS;
+	
+	Frame *frame = &mFrames[output];
+	uint32_t sequence = frame->sequence.load(std::memory_order_relaxed);
+	frame->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	frame->address = address;
+	frame->count = count;
+	frame->stamp = stamp;
+	memcpy(frame->values, values, count);
+	frame->sequence.store(sequence + 2, std::memory_order_release);
+	
+	// Only ring when the reader has not been notified yet
+	if(mHeader->pending.exchange(1) == 0)
+	{
+		uint64_t one = 1;
+		if(write(mDoorbell, &one, sizeof(one)) < 0)
+		{
+			Error("Could not ring the shared memory doorbell: %s", strerror(errno));
+		}
+	}
+}
+
+int SharedUniverse::GetDoorbellFd() const
+{
+	return mDoorbell;
+}
+
+void SharedUniverse::ClearDoorbell()
+{
+	uint64_t value;
+	if(read(mDoorbell, &value, sizeof(value)) < 0 && errno != EAGAIN)
+	{
+		Error("Could not read the shared memory doorbell: %s", strerror(errno));
+	}
+	mHeader->pending.store(0);
+}
+
+bool SharedUniverse::Read(int output, int *address, int *count, uint8_t *values, uint64_t *stamp)
+{
+	assert(IsValid());
+	assert(output >= 0 && output < mOutputs);
+	Frame *frame = &mFrames[output];
+	uint32_t before;
+	uint32_t after;
+	do {
+		before = frame->sequence.load(std::memory_order_acquire);
+		if(before == mReadSequence[output])
+			return false;
+		if(before & 1)
+			continue; // The writer is busy
+		*address = frame->address;
+		*count = frame->count;
+		if(*count < 0 || *count > SHAREDUNIVERSE_MAXCHANNELS)
+			*count = 0;
+		*stamp = frame->stamp;
+		memcpy(values, frame->values, *count);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = frame->sequence.load(std::memory_order_relaxed);
+	} while((before & 1) || before != after);
+	
+	// Every write increments the sequence by two
+	uint32_t written = (before - mReadSequence[output]) / 2;
+	if(written > 1)
+	{
+		mSkippedFrames += written - 1;
+		Metrics::Add(METRIC_FRAMES_COALESCED, written - 1);
+	}
+	mReadSequence[output] = before;
+	return true;
+}
+
+uint64_t SharedUniverse::GetSkippedFrames() const
+{
+	return mSkippedFrames;
+}
@@ -0,0 +1,89 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _SHAREDUNIVERSE_H_
+#define _SHAREDUNIVERSE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+#define SHAREDUNIVERSE_MAXCHANNELS 512
+
+// Channel data of the outputs in memory that is shared between the server
+// and the dmx process. Every output has one frame that is protected by a
+// sequence lock, the server overwrites it and the dmx process reads the
+// latest consistent snapshot. An eventfd tells the dmx process that frames
+// were updated.
+class SharedUniverse
+{
+public:
+	// Create the shared memory for the given number of outputs
+	// This must be done before forking
+	SharedUniverse(int outputs);
+	~SharedUniverse();
+	
+	bool IsValid() const;
+	int GetOutputCount() const;
+	
+	// Writer: store a frame for output and notify the reader
+	// stamp is the receive time of the frame, it is passed to the reader
+	void Write(int output, int address, int count, const uint8_t *values, uint64_t stamp = 0);
+	
+	// Reader: file descriptor that becomes readable when frames are updated
+	int GetDoorbellFd() const;
+	// Reader: acknowledge the notification, must be done before reading the frames
+	void ClearDoorbell();
+	// Reader: copy the frame of output when it changed since the last read
+	// values must have room for SHAREDUNIVERSE_MAXCHANNELS channels
+	// Returns false when the frame did not change
+	bool Read(int output, int *address, int *count, uint8_t *values, uint64_t *stamp);
+	// Reader: number of frames that were overwritten before they were read
+	uint64_t GetSkippedFrames() const;
+	
+private:
+	struct Frame {
+		// Odd while the writer is updating the frame
+		std::atomic<uint32_t> sequence;
+		int32_t address;
+		int32_t count;
+		uint64_t stamp;
+		uint8_t values[SHAREDUNIVERSE_MAXCHANNELS];
+	};
+	// Aligned so the frames that follow the header are aligned
+	struct alignas(8) Header {
+		// Set when the doorbell is rung and not yet acknowledged
+		std::atomic<uint32_t> pending;
+	};
+	
+	int mOutputs;
+	size_t mSize;
+	void *mMemory;
+	Header *mHeader;
+	Frame *mFrames;
+	int mDoorbell;
+	// Reader state, local to the dmx process
+	std::vector<uint32_t> mReadSequence;
+	uint64_t mSkippedFrames;
+};
+
+#endif
@@ -0,0 +1,243 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include "logger.h"
+#include "timehelper.h"
+#include "simulatortransport.h"
+
+SimulatorTransport::SimulatorTransport()
+{
+	mByteTime = 0;
+	mBusTime = 0;
+	mLastByteTime = 0;
+	memset(mChannels, 0xFF, sizeof(mChannels));
+	memset(mInBuffer, 0, sizeof(mInBuffer));
+	memset(mOutBuffer, 0, sizeof(mOutBuffer));
+	mShiftRegister = 0;
+	mCounter = 0;
+	mCommandCount = 0;
+	mRejectedCount = 0;
+	mPort = 0;
+	mChanged = false;
+	mTraceSocket = -1;
+	memset(&mTraceAddress, 0, sizeof(mTraceAddress));
+}
+
+SimulatorTransport::~SimulatorTransport()
+{
+	if(mTraceSocket >= 0)
+		close(mTraceSocket);
+}
+
+bool SimulatorTransport::Open(int port, int speed)
+{
+	if(speed <= 0)
+	{
+		Error("Invalid SPI speed %dkHz", speed);
+		return false;
+	}
+	// 8 clock cycles per byte
+	mPort = port;
+	mByteTime = 8000000LL / speed;
+	mBusTime = GetMonotonicTime();
+	mLastByteTime = mBusTime;
+	Inform("Simulating the interface on SPI port %d with speed %dkHz", port, speed);
+	return true;
+}
+
+void SimulatorTransport::Close()
+{
+}
+
+bool SimulatorTransport::Transfer(SpiTransfer *transfers, int count)
+{
+	int64_t now = GetMonotonicTime();
+	if(mBusTime < now)
+		mBusTime = now;
+	for(int i = 0; i < count; i++)
+	{
+		for(int j = 0; j < transfers[i].length; j++)
+		{
+			if(mBusTime - mLastByteTime > SIMULATOR_TIMEOUT)
+			{
+				mCounter = 0;
+			}
+			mBusTime += mByteTime;
+			mLastByteTime = mBusTime;
+			transfers[i].buffer[j] = ShiftByte(transfers[i].buffer[j]);
+		}
+		mBusTime += transfers[i].delayUs * 1000LL;
+	}
+	
+	// Block until the transfers would have been completed on the bus
+	struct timespec end;
+	end.tv_sec = mBusTime / 1000000000LL;
+	end.tv_nsec = mBusTime % 1000000000LL;
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end, NULL) == EINTR);
+	
+	if(mChanged)
+	{
+		mChanged = false;
+		SendTrace();
+	}
+	return true;
+}
+
+bool SimulatorTransport::SetTrace(const std::string &path)
+{
+	if(path.size() >= sizeof(mTraceAddress.sun_path))
+	{
+		Error("Trace socket path is too long: %s", path.c_str());
+		return false;
+	}
+	mTraceSocket = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(mTraceSocket < 0)
+	{
+		Error("Could not create trace socket: %s", strerror(errno));
+		return false;
+	}
+	mTraceAddress.sun_family = AF_UNIX;
+	strcpy(mTraceAddress.sun_path, path.c_str());
+	return true;
+}
+
+void SimulatorTransport::SendTrace()
+{
+	if(mTraceSocket < 0)
+		return;
+	SimulatorTrace trace;
+	trace.time = mBusTime;
+	trace.port = mPort;
+	memcpy(trace.channels, mChannels, sizeof(trace.channels));
+	// Nobody might be listening, the trace is lost then
+	sendto(mTraceSocket, &trace, sizeof(trace), 0, (struct sockaddr *)&mTraceAddress, sizeof(mTraceAddress));
+}
+
+uint8_t SimulatorTransport::ShiftByte(uint8_t in)
+{
+	// The byte in the shift register is exchanged with the received byte,
+	// after which the interrupt loads the next byte of the send buffer
+	uint8_t out = mShiftRegister;
+	mInBuffer[mCounter] = in;
+	mShiftRegister = mOutBuffer[mCounter];
+	mCounter = (mCounter + 1) & (SIMULATOR_BUFFERSIZE - 1);
+	if(mCounter >= SIMULATOR_COMMANDSIZE)
+	{
+		mCounter = 0;
+		ExecuteCommand();
+	}
+	return out;
+}
+
+void SimulatorTransport::ExecuteCommand()
+{
+	mCommandCount++;
+	uint8_t address;
+	switch(mInBuffer[0])
+	{
+	case 0:
+		// Ignore
+		break;
+	case 1:
+		// Set channel
+		mShiftRegister = 1;
+		for(int i = 0; i < 4; i++)
+		{
+			address = mInBuffer[i*2+1];
+			if(address < SIMULATOR_CHANNELS)
+			{
+				// Address 0 overwrites memory in front of the channels
+				if(address == 0)
+					mRejectedCount++;
+				else
+					mChannels[address-1] = mInBuffer[i*2+2];
+				mChanged = true;
+				mOutBuffer[i*2] = address;
+				mOutBuffer[i*2+1] = mInBuffer[i*2+2];
+			} else {
+				if(address != 0xFF)
+					mRejectedCount++;
+				mOutBuffer[i*2] = 0xFF;
+				mOutBuffer[i*2+1] = 0;
+			}
+		}
+		break;
+	case 2:
+		// Get channels
+		mShiftRegister = 2;
+		address = mInBuffer[1];
+		mOutBuffer[0] = address;
+		for(int i = 0; i < 8; i++)
+		{
+			if(address + i <= SIMULATOR_CHANNELS && address + i > 0)
+				mOutBuffer[i+1] = mChannels[address+i-1];
+			else
+				mOutBuffer[i+1] = 0;
+		}
+		break;
+	case 3:
+		// Set channels
+		mShiftRegister = 3;
+		address = mInBuffer[1];
+		mOutBuffer[0] = address;
+		for(int i = 0; i < 8; i++)
+		{
+			if(address + i <= SIMULATOR_CHANNELS && address + i > 0)
+			{
+				mChannels[address+i-1] = mInBuffer[i+2];
+				mOutBuffer[i+1] = mInBuffer[i+2];
+				mChanged = true;
+			} else {
+				mOutBuffer[i+1] = 0;
+			}
+		}
+		break;
+	case 4:
+		// Get info
+		mShiftRegister = 4;
+		memset(mOutBuffer, 0, SIMULATOR_COMMANDSIZE);
+		mOutBuffer[0] = SIMULATOR_CHANNELS;
+		break;
+	default:
+		mRejectedCount++;
+		break;
+	}
+}
+
+const uint8_t *SimulatorTransport::GetChannels() const
+{
+	return mChannels;
+}
+
+uint64_t SimulatorTransport::GetCommandCount() const
+{
+	return mCommandCount;
+}
+
+uint64_t SimulatorTransport::GetRejectedCount() const
+{
+	return mRejectedCount;
+}
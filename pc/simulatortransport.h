@@ -0,0 +1,103 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _SIMULATORTRANSPORT_H_
+#define _SIMULATORTRANSPORT_H_
+
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "spitransport.h"
+
+// Number of channels of the simulated interface
+#define SIMULATOR_CHANNELS 64
+// Size of the receive and send buffers of the interface
+#define SIMULATOR_BUFFERSIZE 16
+// Size of a command
+#define SIMULATOR_COMMANDSIZE 10
+// The interface starts a new command when no byte is received for this long
+#define SIMULATOR_TIMEOUT 2000000
+
+// Message that the simulator sends to the trace socket after every transfer
+// that changed channels
+struct SimulatorTrace {
+	// Monotonic time in ns at which the transfers were completed on the bus
+	int64_t time;
+	int32_t port;
+	uint8_t channels[SIMULATOR_CHANNELS];
+};
+
+// SPI transport that simulates the spi-dmx interface in process
+// It implements the command set of hardware/firmware/spidmx.c byte by byte:
+// the reply to a command is shifted out during the next command, the
+// interface has 64 channels and a transfer takes as long as it would take
+// on the bus at the configured speed.
+class SimulatorTransport : public SpiTransport
+{
+public:
+	SimulatorTransport();
+	~SimulatorTransport();
+	
+	bool Open(int port, int speed);
+	void Close();
+	bool Transfer(SpiTransfer *transfers, int count);
+	
+	// Send the channel values to the unix datagram socket at path after
+	// every transfer that changed channels
+	bool SetTrace(const std::string &path);
+	
+	// Current values of the dmx channels of the interface
+	const uint8_t *GetChannels() const;
+	// Number of commands that were executed by the interface
+	uint64_t GetCommandCount() const;
+	// Number of commands with an address that is not accepted by the interface
+	uint64_t GetRejectedCount() const;
+	
+private:
+	// Shift one byte in and out, returns the byte that is shifted out
+	uint8_t ShiftByte(uint8_t in);
+	// Execute the received command like the main loop of the firmware
+	void ExecuteCommand();
+	void SendTrace();
+	
+	int64_t mByteTime;
+	// Time at which the bus is idle again
+	int64_t mBusTime;
+	// Time at which the last byte was received
+	int64_t mLastByteTime;
+	
+	uint8_t mChannels[SIMULATOR_CHANNELS];
+	uint8_t mInBuffer[SIMULATOR_BUFFERSIZE];
+	uint8_t mOutBuffer[SIMULATOR_BUFFERSIZE];
+	uint8_t mShiftRegister;
+	int mCounter;
+	uint64_t mCommandCount;
+	uint64_t mRejectedCount;
+	
+	int mPort;
+	// Set when a command changed the channels
+	bool mChanged;
+	int mTraceSocket;
+	struct sockaddr_un mTraceAddress;
+};
+
+#endif
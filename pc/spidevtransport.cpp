@@ -0,0 +1,103 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include "logger.h"
+#include "spidevtransport.h"
+
+SpidevTransport::SpidevTransport()
+{
+	mFd = -1;
+	mSpeed = 0;
+	memset(mMessage, 0, sizeof(mMessage));
+}
+
+SpidevTransport::~SpidevTransport()
+{
+	Close();
+}
+
+bool SpidevTransport::Open(int port, int speed)
+{
+	char device[32];
+	snprintf(device, sizeof(device), "/dev/spidev0.%d", port);
+	mFd = open(device, O_RDWR | O_CLOEXEC);
+	if(mFd < 0)
+	{
+		Error("Could not open %s: %s", device, strerror(errno));
+		return false;
+	}
+	
+	uint8_t mode = SPI_MODE_0;
+	uint8_t bits = 8;
+	mSpeed = speed * 1000;
+	if(ioctl(mFd, SPI_IOC_WR_MODE, &mode) < 0 ||
+		ioctl(mFd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+		ioctl(mFd, SPI_IOC_WR_MAX_SPEED_HZ, &mSpeed) < 0)
+	{
+		Error("Could not configure %s with speed %dkHz: %s", device, speed, strerror(errno));
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void SpidevTransport::Close()
+{
+	if(mFd != -1)
+		close(mFd);
+	mFd = -1;
+}
+
+bool SpidevTransport::Transfer(SpiTransfer *transfers, int count)
+{
+	while(count > 0)
+	{
+		int n = count < SPIDEV_MAXTRANSFERS ? count : SPIDEV_MAXTRANSFERS;
+		for(int i = 0; i < n; i++)
+		{
+			struct spi_ioc_transfer &transfer = mMessage[i];
+			transfer.tx_buf = (unsigned long)transfers[i].buffer;
+			transfer.rx_buf = (unsigned long)transfers[i].buffer;
+			transfer.len = transfers[i].length;
+			transfer.speed_hz = mSpeed;
+			transfer.delay_usecs = transfers[i].delayUs;
+			transfer.bits_per_word = 8;
+			transfer.cs_change = transfers[i].csChange ? 1 : 0;
+		}
+		// The chip select is always released at the end of the message
+		mMessage[n-1].cs_change = 0;
+		if(ioctl(mFd, SPI_IOC_MESSAGE(n), mMessage) < 0)
+		{
+			Error("SPI transfer failed: %s", strerror(errno));
+			return false;
+		}
+		transfers += n;
+		count -= n;
+	}
+	return true;
+}
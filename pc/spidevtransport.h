@@ -0,0 +1,50 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _SPIDEVTRANSPORT_H_
+#define _SPIDEVTRANSPORT_H_
+
+#include <stdint.h>
+#include <linux/spi/spidev.h>
+#include "spitransport.h"
+
+// Maximum number of transfers in one SPI_IOC_MESSAGE call
+#define SPIDEV_MAXTRANSFERS 64
+
+// SPI transport that uses /dev/spidev directly
+// All transfers of a call are submitted to the kernel with a single ioctl
+class SpidevTransport : public SpiTransport
+{
+public:
+	SpidevTransport();
+	~SpidevTransport();
+	
+	bool Open(int port, int speed);
+	void Close();
+	bool Transfer(SpiTransfer *transfers, int count);
+	
+private:
+	int mFd;
+	uint32_t mSpeed;
+	struct spi_ioc_transfer mMessage[SPIDEV_MAXTRANSFERS];
+};
+
+#endif
@@ -0,0 +1,61 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "logger.h"
+#include "stringhelper.h"
+#include "settings.h"
+#include "spidevtransport.h"
+#include "wiringpitransport.h"
+#include "simulatortransport.h"
+#include "nulltransport.h"
+#include "spitransport.h"
+
+SpiTransport *CreateSpiTransport(std::string backend)
+{
+	backend = ToLower(backend);
+	if(backend == "wiringpi")
+	{
+#ifdef HAVE_WIRINGPI
+		return new WiringPiTransport();
+#else
+		Error("dmxd is compiled without wiringPi support");
+		return NULL;
+#endif
+	}
+	if(backend == "simulator")
+	{
+		SimulatorTransport *simulator = new SimulatorTransport();
+		std::string trace = Settings::GetSimulatorTrace();
+		if(ToLower(trace) != "off")
+			simulator->SetTrace(trace);
+		return simulator;
+	}
+	if(backend == "null")
+	{
+		return new NullTransport();
+	}
+	if(backend != "spidev")
+	{
+		Warn("Unknown SPI backend \"%s\", using spidev", backend.c_str());
+	}
+	return new SpidevTransport();
+}
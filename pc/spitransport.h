@@ -0,0 +1,57 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _SPITRANSPORT_H_
+#define _SPITRANSPORT_H_
+
+#include <string>
+#include <stdint.h>
+
+// A single transfer of a SPI message
+// The received bytes overwrite the sent bytes in buffer
+struct SpiTransfer {
+	uint8_t *buffer;
+	int length;
+	// Time to wait after the transfer in microseconds
+	int delayUs;
+	// Deselect the device between this transfer and the next one
+	bool csChange;
+};
+
+// Interface of a SPI bus implementation used by DmxControl
+class SpiTransport
+{
+public:
+	virtual ~SpiTransport() {}
+	
+	// Open the SPI port with the speed in kHz
+	virtual bool Open(int port, int speed) = 0;
+	virtual void Close() = 0;
+	// Execute the transfers in order
+	// Returns false when the transfers could not be executed
+	virtual bool Transfer(SpiTransfer *transfers, int count) = 0;
+};
+
+// Create the SPI transport with the given name(spidev, wiringpi, simulator, null)
+// Returns NULL when the transport is not available
+SpiTransport *CreateSpiTransport(std::string backend);
+
+#endif
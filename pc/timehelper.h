@@ -0,0 +1,44 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+#ifndef _TIMEHELPER_H_
+#define _TIMEHELPER_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+
+// Size of the control buffer of a datagram that receives the SO_TIMESTAMPNS stamp
+#define RECEIVETIME_CONTROLSIZE CMSG_SPACE(sizeof(struct timespec))
+
+// Returns the time of the monotonic clock in nanoseconds
+uint64_t GetMonotonicTime();
+// Returns the time of the realtime clock in nanoseconds
+uint64_t GetRealTime();
+// Convert a timespec to nanoseconds
+uint64_t TimespecToNs(const struct timespec &ts);
+// Convert nanoseconds to a timespec
+struct timespec NsToTimespec(uint64_t ns);
+// Returns the SO_TIMESTAMPNS receive time of a datagram on the realtime clock
+// Returns the current realtime when the datagram has no stamp
+uint64_t GetReceiveTime(const struct msghdr &message);
+
+#endif
@@ -0,0 +1,77 @@
+/*The MIT License (MIT)
+
+Copyright (c) 2015 Robbert-Jan de Jager
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifdef HAVE_WIRINGPI
+
+#include <wiringPiSPI.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "logger.h"
+#include "wiringpitransport.h"
+
+WiringPiTransport::WiringPiTransport()
+{
+	mPort = 0;
+	mFd = -1;
+}
+
+WiringPiTransport::~WiringPiTransport()
+{
+	Close();
+}
+
+bool WiringPiTransport::Open(int port, int speed)
+{
+	mPort = port;
+	mFd = wiringPiSPISetup(port, speed*1000);
+	if(mFd == -1)
+	{
+		Error("Could not open SPI port %d with speed %dkHz: %s", port, speed, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+void WiringPiTransport::Close()
+{
+	if(mFd != -1)
+		close(mFd);
+	mFd = -1;
+}
+
+bool WiringPiTransport::Transfer(SpiTransfer *transfers, int count)
+{
+	// The time between two calls is already longer than the delays the
+	// interface needs, so the delays are not added
+	for(int i = 0; i < count; i++)
+	{
+		if(wiringPiSPIDataRW(mPort, transfers[i].buffer, transfers[i].length) < 0)
+		{
+			Error("SPI transfer failed: %s", strerror(errno));
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif